@@ -0,0 +1,280 @@
+#include "pch.h"
+#include "ApngFrameWriter.h"
+#include "PngFilter.h"
+#include "Deflate.h"
+
+namespace winrt
+{
+    using namespace Windows::Graphics;
+    using namespace Windows::Storage::Streams;
+}
+
+namespace util
+{
+    using namespace robmikh::common::uwp;
+}
+
+// https://www.w3.org/TR/png/#5PNG-file-signature
+const std::array<uint8_t, 8> PngSignature = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+const uint8_t PngColorTypeRgba = 6;
+const uint8_t ApngDisposeOpNone = 0;
+// Transparent pixels leave the previous frame showing through
+const uint8_t ApngBlendOpOver = 1;
+// Roughly how much raw data goes into each band
+const size_t ApngBandSize = 128 * 1024;
+
+std::array<uint32_t, 256> CreateCrcTable()
+{
+    std::array<uint32_t, 256> table = {};
+    for (auto i = 0u; i < table.size(); i++)
+    {
+        auto value = i;
+        for (auto bit = 0; bit < 8; bit++)
+        {
+            value = (value & 1) ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+        }
+        table[i] = value;
+    }
+    return table;
+}
+
+const std::array<uint32_t, 256> CrcTable = CreateCrcTable();
+
+uint32_t UpdateCrc(uint32_t crc, uint8_t const* data, size_t size)
+{
+    for (auto i = 0u; i < size; i++)
+    {
+        crc = CrcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+void AppendUInt32(std::vector<uint8_t>& data, uint32_t value)
+{
+    data.push_back(static_cast<uint8_t>(value >> 24));
+    data.push_back(static_cast<uint8_t>(value >> 16));
+    data.push_back(static_cast<uint8_t>(value >> 8));
+    data.push_back(static_cast<uint8_t>(value));
+}
+
+void AppendUInt16(std::vector<uint8_t>& data, uint16_t value)
+{
+    data.push_back(static_cast<uint8_t>(value >> 8));
+    data.push_back(static_cast<uint8_t>(value));
+}
+
+ApngFrameWriter::ApngFrameWriter(
+    winrt::IRandomAccessStream const& stream,
+    winrt::SizeInt32 size,
+    std::shared_ptr<EncoderThreadPool> const& threadPool)
+{
+    m_stream = util::CreateStreamFromRandomAccessStream(stream);
+    m_size = size;
+    for (auto i = 0u; i < threadPool->ThreadCount(); i++)
+    {
+        m_bandQueues.push_back(threadPool->CreateQueue());
+    }
+
+    WriteBytes(PngSignature.data(), PngSignature.size());
+
+    // Image header
+    {
+        std::vector<uint8_t> header;
+        AppendUInt32(header, static_cast<uint32_t>(size.Width));
+        AppendUInt32(header, static_cast<uint32_t>(size.Height));
+        header.push_back(8); // Bit depth
+        header.push_back(PngColorTypeRgba);
+        header.push_back(0); // Compression method
+        header.push_back(0); // Filter method
+        header.push_back(0); // Interlace method
+        WriteChunk("IHDR", { { header.data(), header.size() } });
+    }
+
+    // We don't know how many frames there will be yet, we'll come back
+    // and fill this in when we commit.
+    ULARGE_INTEGER position = {};
+    winrt::check_hresult(m_stream->Seek({}, STREAM_SEEK_CUR, &position));
+    m_animationControlOffset = position.QuadPart;
+    WriteAnimationControl();
+}
+
+ApngFrameWriter::~ApngFrameWriter()
+{
+    // Our pending tasks reference us
+    for (auto&& queue : m_bandQueues)
+    {
+        queue->Wait();
+    }
+}
+
+void ApngFrameWriter::WriteFrame(std::shared_ptr<PixelBuffer> const& pixels, DiffRect const& rect, std::chrono::milliseconds delay)
+{
+    auto rowSize = static_cast<size_t>(pixels->Width) * 4 + 1;
+    auto rowsPerBand = static_cast<uint32_t>(std::max<size_t>(ApngBandSize / rowSize, 1));
+    auto bandCount = (pixels->Height + rowsPerBand - 1) / rowsPerBand;
+
+    auto frame = std::make_shared<CompressedFrame>();
+    frame->Index = m_frameCount++;
+    frame->Rect = rect;
+    frame->Delay = delay;
+    frame->Bands.resize(bandCount);
+    frame->BandAdlers.resize(bandCount);
+    frame->BandSizes.resize(bandCount);
+    frame->RemainingBands = bandCount;
+
+    for (auto band = 0u; band < bandCount; band++)
+    {
+        auto firstRow = band * rowsPerBand;
+        auto rowCount = std::min(rowsPerBand, pixels->Height - firstRow);
+        auto& queue = m_bandQueues[m_nextBandQueue++ % m_bandQueues.size()];
+        queue->Submit([this, frame, pixels, band, firstRow, rowCount]()
+        {
+            CompressBand(frame, *pixels, band, firstRow, rowCount);
+        });
+    }
+}
+
+void ApngFrameWriter::Commit()
+{
+    for (auto&& queue : m_bandQueues)
+    {
+        queue->Flush();
+    }
+
+    std::lock_guard lock(m_writeLock);
+    WINRT_ASSERT(m_completedFrames.empty());
+
+    WriteChunk("IEND", {});
+
+    // Now that we know the frame count, fix up the animation control chunk
+    ULARGE_INTEGER end = {};
+    winrt::check_hresult(m_stream->Seek({}, STREAM_SEEK_CUR, &end));
+    LARGE_INTEGER offset = {};
+    offset.QuadPart = static_cast<int64_t>(m_animationControlOffset);
+    winrt::check_hresult(m_stream->Seek(offset, STREAM_SEEK_SET, nullptr));
+    WriteAnimationControl();
+    offset.QuadPart = static_cast<int64_t>(end.QuadPart);
+    winrt::check_hresult(m_stream->Seek(offset, STREAM_SEEK_SET, nullptr));
+
+    winrt::check_hresult(m_stream->Commit(STGC_DEFAULT));
+}
+
+void ApngFrameWriter::CompressBand(std::shared_ptr<CompressedFrame> const& frame, PixelBuffer const& pixels, size_t band, uint32_t firstRow, uint32_t rowCount)
+{
+    std::vector<uint8_t> filtered;
+    FilterPngRows(pixels, firstRow, rowCount, filtered);
+    frame->BandAdlers[band] = Adler32(filtered.data(), filtered.size());
+    frame->BandSizes[band] = filtered.size();
+    frame->Bands[band] = DeflateBlocks(filtered.data(), filtered.size());
+
+    // Whoever finishes the last band gets to write the frame
+    if (--frame->RemainingBands == 0)
+    {
+        WriteCompletedFrames(frame);
+    }
+}
+
+void ApngFrameWriter::WriteCompletedFrames(std::shared_ptr<CompressedFrame> const& frame)
+{
+    std::lock_guard lock(m_writeLock);
+    m_completedFrames.emplace(frame->Index, frame);
+
+    // Bands finish out of order, so a frame may have to wait for the ones before it
+    auto it = m_completedFrames.find(m_nextFrameToWrite);
+    while (it != m_completedFrames.end())
+    {
+        WriteFrameChunks(*it->second);
+        m_completedFrames.erase(it);
+        m_nextFrameToWrite++;
+        it = m_completedFrames.find(m_nextFrameToWrite);
+    }
+}
+
+void ApngFrameWriter::WriteFrameChunks(CompressedFrame const& frame)
+{
+    // Frame control
+    {
+        std::vector<uint8_t> control;
+        AppendUInt32(control, m_sequenceNumber++);
+        AppendUInt32(control, frame.Rect.Right - frame.Rect.Left);
+        AppendUInt32(control, frame.Rect.Bottom - frame.Rect.Top);
+        AppendUInt32(control, frame.Rect.Left);
+        AppendUInt32(control, frame.Rect.Top);
+        // Delay in milliseconds
+        AppendUInt16(control, static_cast<uint16_t>(std::min<int64_t>(frame.Delay.count(), std::numeric_limits<uint16_t>::max())));
+        AppendUInt16(control, 1000);
+        control.push_back(ApngDisposeOpNone);
+        control.push_back(ApngBlendOpOver);
+        WriteChunk("fcTL", { { control.data(), control.size() } });
+    }
+
+    // Stitch the bands together into one zlib stream
+    auto adler = 1u;
+    for (auto band = 0u; band < frame.Bands.size(); band++)
+    {
+        adler = Adler32Combine(adler, frame.BandAdlers[band], frame.BandSizes[band]);
+    }
+    auto header = ZlibHeader();
+    auto finish = ZlibFinish(adler);
+
+    std::vector<uint8_t> sequenceNumber;
+    std::vector<ChunkPiece> pieces;
+    // The first frame doubles as the default image
+    auto isDefaultImage = frame.Index == 0;
+    if (!isDefaultImage)
+    {
+        AppendUInt32(sequenceNumber, m_sequenceNumber++);
+        pieces.push_back({ sequenceNumber.data(), sequenceNumber.size() });
+    }
+    pieces.push_back({ header.data(), header.size() });
+    for (auto&& band : frame.Bands)
+    {
+        pieces.push_back({ band.data(), band.size() });
+    }
+    pieces.push_back({ finish.data(), finish.size() });
+    WriteChunk(isDefaultImage ? "IDAT" : "fdAT", pieces);
+}
+
+void ApngFrameWriter::WriteAnimationControl()
+{
+    std::vector<uint8_t> control;
+    AppendUInt32(control, static_cast<uint32_t>(m_frameCount));
+    AppendUInt32(control, 0); // Loop forever
+    WriteChunk("acTL", { { control.data(), control.size() } });
+}
+
+void ApngFrameWriter::WriteChunk(char const* type, std::vector<ChunkPiece> const& pieces)
+{
+    size_t size = 0;
+    for (auto&& piece : pieces)
+    {
+        size += piece.Size;
+    }
+
+    std::vector<uint8_t> header;
+    AppendUInt32(header, static_cast<uint32_t>(size));
+    header.insert(header.end(), type, type + 4);
+    WriteBytes(header.data(), header.size());
+
+    // The CRC covers the type and the data, but not the length
+    auto crc = UpdateCrc(0xFFFFFFFF, header.data() + 4, 4);
+    for (auto&& piece : pieces)
+    {
+        crc = UpdateCrc(crc, piece.Data, piece.Size);
+        WriteBytes(piece.Data, piece.Size);
+    }
+
+    std::vector<uint8_t> footer;
+    AppendUInt32(footer, crc ^ 0xFFFFFFFF);
+    WriteBytes(footer.data(), footer.size());
+}
+
+void ApngFrameWriter::WriteBytes(void const* data, size_t size)
+{
+    ULONG written = 0;
+    winrt::check_hresult(m_stream->Write(data, static_cast<ULONG>(size), &written));
+    if (written != size)
+    {
+        throw winrt::hresult_error(STG_E_MEDIUMFULL);
+    }
+}
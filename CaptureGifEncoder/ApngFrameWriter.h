@@ -0,0 +1,56 @@
+#pragma once
+#include "FrameWriter.h"
+
+// Writes frames as a lossless animated PNG. Each frame is split into
+// bands of rows that are filtered and deflated in parallel on the pool,
+// and finished frames are written to the stream in order.
+class ApngFrameWriter : public FrameWriter
+{
+public:
+    ApngFrameWriter(
+        winrt::Windows::Storage::Streams::IRandomAccessStream const& stream,
+        winrt::Windows::Graphics::SizeInt32 size,
+        std::shared_ptr<EncoderThreadPool> const& threadPool);
+    ~ApngFrameWriter();
+
+    void WriteFrame(std::shared_ptr<PixelBuffer> const& pixels, DiffRect const& rect, std::chrono::milliseconds delay) override;
+    void Commit() override;
+
+private:
+    struct CompressedFrame
+    {
+        uint64_t Index = 0;
+        DiffRect Rect = {};
+        std::chrono::milliseconds Delay = {};
+        std::vector<std::vector<uint8_t>> Bands;
+        std::vector<uint32_t> BandAdlers;
+        std::vector<size_t> BandSizes;
+        std::atomic<size_t> RemainingBands = 0;
+    };
+
+    struct ChunkPiece
+    {
+        uint8_t const* Data;
+        size_t Size;
+    };
+
+    void CompressBand(std::shared_ptr<CompressedFrame> const& frame, PixelBuffer const& pixels, size_t band, uint32_t firstRow, uint32_t rowCount);
+    void WriteCompletedFrames(std::shared_ptr<CompressedFrame> const& frame);
+    void WriteFrameChunks(CompressedFrame const& frame);
+    void WriteAnimationControl();
+    void WriteChunk(char const* type, std::vector<ChunkPiece> const& pieces);
+    void WriteBytes(void const* data, size_t size);
+
+private:
+    winrt::com_ptr<IStream> m_stream;
+    winrt::Windows::Graphics::SizeInt32 m_size = {};
+    std::vector<std::shared_ptr<EncoderQueue>> m_bandQueues;
+    size_t m_nextBandQueue = 0;
+    uint64_t m_frameCount = 0;
+    uint64_t m_animationControlOffset = 0;
+
+    std::mutex m_writeLock;
+    std::map<uint64_t, std::shared_ptr<CompressedFrame>> m_completedFrames;
+    uint64_t m_nextFrameToWrite = 0;
+    uint32_t m_sequenceNumber = 0;
+};
@@ -0,0 +1,76 @@
+#include "pch.h"
+#include "Benchmark.h"
+#include "GifEncoder.h"
+#include "SyntheticFrameSource.h"
+
+namespace winrt
+{
+    using namespace Windows::Graphics;
+    using namespace Windows::Storage::Streams;
+}
+
+namespace util
+{
+    using namespace robmikh::common::uwp;
+}
+
+void RunBenchmark(uint32_t sourceCount, uint32_t frameCount, OutputFormat format)
+{
+    winrt::SizeInt32 frameSize = { 1280, 720 };
+    wprintf(L"Encoding %u frames from each of %u sources (%dx%d)...\n", frameCount, sourceCount, frameSize.Width, frameSize.Height);
+
+    // Init D3D and WIC
+    auto d3dDevice = util::CreateD3DDevice();
+    winrt::com_ptr<ID3D11DeviceContext> d3dContext;
+    d3dDevice->GetImmediateContext(d3dContext.put());
+    d3dContext.as<ID3D11Multithread>()->SetMultithreadProtected(true);
+    auto wicFactory = util::CreateWICFactory();
+
+    auto threadPool = std::make_shared<EncoderThreadPool>(std::thread::hardware_concurrency());
+    auto bufferPool = std::make_shared<PixelBufferPool>();
+
+    std::vector<winrt::InMemoryRandomAccessStream> streams;
+    std::vector<std::shared_ptr<GifEncoder>> encoders;
+    std::vector<std::unique_ptr<SyntheticFrameSource>> sources;
+    for (auto i = 0u; i < sourceCount; i++)
+    {
+        winrt::InMemoryRandomAccessStream stream;
+        auto frameWriter = CreateFrameWriter(format, wicFactory, stream, frameSize, threadPool);
+        encoders.push_back(std::make_shared<GifEncoder>(d3dDevice, d3dContext, std::move(frameWriter), frameSize, threadPool, bufferPool));
+        sources.push_back(std::make_unique<SyntheticFrameSource>(d3dDevice, d3dContext, frameSize, i));
+        streams.push_back(stream);
+    }
+
+    // Each source gets its own thread, just like a free threaded frame pool
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (auto i = 0u; i < sourceCount; i++)
+    {
+        threads.emplace_back([&, i]()
+        {
+            for (auto frameIndex = 0u; frameIndex < frameCount; frameIndex++)
+            {
+                auto frame = sources[i]->NextFrame();
+                encoders[i]->SetOverlay(frame.Overlay);
+                encoders[i]->ProcessFrame(frame.Texture, frame.ContentSize, frame.SystemRelativeTime);
+            }
+        });
+    }
+    for (auto&& thread : threads)
+    {
+        thread.join();
+    }
+    for (auto&& encoder : encoders)
+    {
+        encoder->StopEncoding();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - start);
+
+    auto totalFrames = static_cast<double>(sourceCount) * frameCount;
+    wprintf(L"Encoded %.0f frames in %.3fs using %zu threads (%.1f fps)\n", totalFrames, elapsed.count(), threadPool->ThreadCount(), totalFrames / elapsed.count());
+    for (auto i = 0u; i < sourceCount; i++)
+    {
+        wprintf(L"Source %u: %llu bytes\n", i, streams[i].Size());
+        PrintEncoderStats(encoders[i]->Stats());
+    }
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include "FrameWriter.h"
+
+// Drives several synthetic sources through a shared encoder pool and
+// reports the combined throughput.
+void RunBenchmark(uint32_t sourceCount, uint32_t frameCount, OutputFormat format);
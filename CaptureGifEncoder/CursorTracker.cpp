@@ -0,0 +1,161 @@
+#include "pch.h"
+#include "CursorTracker.h"
+
+CursorTracker::CursorTracker(HWND window)
+{
+    m_window = window;
+}
+
+std::optional<OverlayPlacement> CursorTracker::Update()
+{
+    CURSORINFO cursorInfo = {};
+    cursorInfo.cbSize = sizeof(cursorInfo);
+    // This fails while another desktop (e.g. UAC) is up
+    if (!GetCursorInfo(&cursorInfo) || !(cursorInfo.flags & CURSOR_SHOWING) || cursorInfo.hCursor == nullptr)
+    {
+        return std::nullopt;
+    }
+
+    // Cursor images don't change, so we only need to render new ones
+    if (cursorInfo.hCursor != m_cursor)
+    {
+        RenderCursor(cursorInfo.hCursor);
+        m_cursor = cursorInfo.hCursor;
+    }
+
+    // The window can move, or go away, while we're recording
+    RECT windowRect = {};
+    if (FAILED(DwmGetWindowAttribute(m_window, DWMWA_EXTENDED_FRAME_BOUNDS, reinterpret_cast<void*>(&windowRect), sizeof(windowRect))))
+    {
+        return std::nullopt;
+    }
+
+    // Both are in physical pixels since the process is per monitor DPI aware
+    OverlayPlacement overlay = {};
+    overlay.Image = m_image;
+    overlay.Left = cursorInfo.ptScreenPos.x - m_hotspot.x - windowRect.left;
+    overlay.Top = cursorInfo.ptScreenPos.y - m_hotspot.y - windowRect.top;
+
+    // Anywhere else on the desktop it's as good as hidden
+    auto windowWidth = static_cast<uint32_t>(windowRect.right - windowRect.left);
+    auto windowHeight = static_cast<uint32_t>(windowRect.bottom - windowRect.top);
+    if (!GetOverlayRect(overlay, windowWidth, windowHeight).has_value())
+    {
+        return std::nullopt;
+    }
+    return std::optional(overlay);
+}
+
+void CursorTracker::RenderCursor(HCURSOR cursor)
+{
+    ICONINFO iconInfo = {};
+    winrt::check_bool(GetIconInfo(cursor, &iconInfo));
+    wil::unique_hbitmap colorBitmap(iconInfo.hbmColor);
+    wil::unique_hbitmap maskBitmap(iconInfo.hbmMask);
+    m_hotspot = { static_cast<LONG>(iconInfo.xHotspot), static_cast<LONG>(iconInfo.yHotspot) };
+
+    // Monochrome cursors stack their AND and XOR masks in one bitmap
+    BITMAP bitmap = {};
+    winrt::check_bool(GetObjectW(maskBitmap.get(), sizeof(bitmap), &bitmap));
+    auto width = static_cast<uint32_t>(bitmap.bmWidth);
+    auto height = static_cast<uint32_t>(colorBitmap ? bitmap.bmHeight : bitmap.bmHeight / 2);
+
+    // GDI won't hand us the alpha directly, so draw the cursor over black
+    // and over white and work it out from the difference.
+    auto renderOver = [&](COLORREF background)
+    {
+        BITMAPINFO bitmapInfo = {};
+        bitmapInfo.bmiHeader.biSize = sizeof(bitmapInfo.bmiHeader);
+        bitmapInfo.bmiHeader.biWidth = static_cast<LONG>(width);
+        bitmapInfo.bmiHeader.biHeight = -static_cast<LONG>(height);
+        bitmapInfo.bmiHeader.biPlanes = 1;
+        bitmapInfo.bmiHeader.biBitCount = 32;
+        bitmapInfo.bmiHeader.biCompression = BI_RGB;
+
+        wil::unique_hdc dc(CreateCompatibleDC(nullptr));
+        winrt::check_pointer(dc.get());
+        void* bits = nullptr;
+        wil::unique_hbitmap dib(CreateDIBSection(dc.get(), &bitmapInfo, DIB_RGB_COLORS, &bits, nullptr, 0));
+        winrt::check_pointer(dib.get());
+        auto previousBitmap = SelectObject(dc.get(), dib.get());
+
+        wil::unique_hbrush brush(CreateSolidBrush(background));
+        RECT rect = { 0, 0, static_cast<LONG>(width), static_cast<LONG>(height) };
+        FillRect(dc.get(), &rect, brush.get());
+        winrt::check_bool(DrawIconEx(dc.get(), 0, 0, cursor, static_cast<int>(width), static_cast<int>(height), 0, nullptr, DI_NORMAL));
+        GdiFlush();
+
+        std::vector<uint32_t> pixels(static_cast<size_t>(width) * height);
+        memcpy(pixels.data(), bits, pixels.size() * sizeof(uint32_t));
+        SelectObject(dc.get(), previousBitmap);
+        return pixels;
+    };
+    auto overBlack = renderOver(RGB(0, 0, 0));
+    auto overWhite = renderOver(RGB(255, 255, 255));
+
+    auto image = std::make_shared<PixelBuffer>();
+    image->Width = width;
+    image->Height = height;
+    image->Stride = width * 4;
+    image->Data.resize(static_cast<size_t>(image->Stride) * height);
+    auto output = reinterpret_cast<uint32_t*>(image->Data.data());
+    std::vector<bool> inverted(overBlack.size());
+    for (auto i = 0u; i < overBlack.size(); i++)
+    {
+        auto black = (overBlack[i] >> 8) & 0xFF;
+        auto white = (overWhite[i] >> 8) & 0xFF;
+
+        // Pixels from the XOR mask (like most of the I-beam) invert what's
+        // under them, so they come out brighter over black than over white.
+        // We can't invert with a blend, so they're drawn black instead and
+        // outlined below to keep them visible over dark content.
+        if (white < black)
+        {
+            inverted[i] = true;
+            output[i] = 0xFF000000;
+            continue;
+        }
+
+        // Over black we get the premultiplied color, and the background
+        // shows through by however transparent the cursor is.
+        auto alpha = 255 - (white - black);
+        uint32_t pixel = alpha << 24;
+        for (auto shift = 0u; shift < 24; shift += 8)
+        {
+            pixel |= std::min((overBlack[i] >> shift) & 0xFF, alpha) << shift;
+        }
+        output[i] = pixel;
+    }
+
+    // Give the inverted pixels a white outline wherever they border
+    // transparent ones
+    for (auto y = 0u; y < height; y++)
+    {
+        for (auto x = 0u; x < width; x++)
+        {
+            auto i = static_cast<size_t>(y) * width + x;
+            if (output[i] != 0)
+            {
+                continue;
+            }
+
+            auto bordersInverted = false;
+            for (auto neighborY = y > 0 ? y - 1 : 0; neighborY <= std::min(y + 1, height - 1) && !bordersInverted; neighborY++)
+            {
+                for (auto neighborX = x > 0 ? x - 1 : 0; neighborX <= std::min(x + 1, width - 1); neighborX++)
+                {
+                    if (inverted[static_cast<size_t>(neighborY) * width + neighborX])
+                    {
+                        bordersInverted = true;
+                        break;
+                    }
+                }
+            }
+            if (bordersInverted)
+            {
+                output[i] = 0xFFFFFFFF;
+            }
+        }
+    }
+    m_image = image;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "OverlayBlend.h"
+
+// Follows the mouse cursor over a window, so that it can be drawn as an
+// overlay instead of being baked into the captured frames.
+class CursorTracker
+{
+public:
+    CursorTracker(HWND window);
+
+    // Where the cursor is right now, relative to the window's frame bounds
+    std::optional<OverlayPlacement> Update();
+
+private:
+    void RenderCursor(HCURSOR cursor);
+
+private:
+    HWND m_window = nullptr;
+    HCURSOR m_cursor = nullptr;
+    std::shared_ptr<PixelBuffer const> m_image;
+    POINT m_hotspot = {};
+};
@@ -0,0 +1,279 @@
+// Doesn't use the precompiled header, so that it builds without Windows
+// headers for the tests
+#include "Deflate.h"
+#include <algorithm>
+
+const uint32_t WindowSize = 32768;
+const uint32_t HashBits = 15;
+const uint32_t MaxChainLength = 32;
+const uint32_t MinMatch = 3;
+const uint32_t MaxMatch = 258;
+const uint32_t AdlerBase = 65521;
+
+const std::array<uint16_t, 29> LengthBases = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const std::array<uint8_t, 29> LengthExtraBits = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const std::array<uint16_t, 30> DistanceBases = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const std::array<uint8_t, 30> DistanceExtraBits = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+uint32_t ReverseBits(uint32_t value, uint32_t bitCount)
+{
+    uint32_t result = 0;
+    for (auto i = 0u; i < bitCount; i++)
+    {
+        result = (result << 1) | ((value >> i) & 1);
+    }
+    return result;
+}
+
+struct HuffmanCode
+{
+    uint16_t Code;
+    uint8_t BitCount;
+};
+
+// The fixed literal/length codes from RFC 1951 3.2.6, already bit reversed
+// since deflate packs Huffman codes starting with their most significant bit.
+std::array<HuffmanCode, 288> CreateFixedLiteralCodes()
+{
+    std::array<HuffmanCode, 288> codes = {};
+    for (auto symbol = 0u; symbol < codes.size(); symbol++)
+    {
+        uint32_t code = 0;
+        uint32_t bitCount = 0;
+        if (symbol < 144)
+        {
+            code = 0x30 + symbol;
+            bitCount = 8;
+        }
+        else if (symbol < 256)
+        {
+            code = 0x190 + (symbol - 144);
+            bitCount = 9;
+        }
+        else if (symbol < 280)
+        {
+            code = symbol - 256;
+            bitCount = 7;
+        }
+        else
+        {
+            code = 0xC0 + (symbol - 280);
+            bitCount = 8;
+        }
+        codes[symbol] = { static_cast<uint16_t>(ReverseBits(code, bitCount)), static_cast<uint8_t>(bitCount) };
+    }
+    return codes;
+}
+
+const std::array<HuffmanCode, 288> FixedLiteralCodes = CreateFixedLiteralCodes();
+
+class BitWriter
+{
+public:
+    BitWriter(std::vector<uint8_t>& output) : m_output(output) {}
+
+    void Write(uint32_t value, uint32_t bitCount)
+    {
+        m_bits |= static_cast<uint64_t>(value) << m_bitCount;
+        m_bitCount += bitCount;
+        while (m_bitCount >= 8)
+        {
+            m_output.push_back(static_cast<uint8_t>(m_bits));
+            m_bits >>= 8;
+            m_bitCount -= 8;
+        }
+    }
+
+    void AlignToByte()
+    {
+        if (m_bitCount > 0)
+        {
+            Write(0, 8 - m_bitCount);
+        }
+    }
+
+private:
+    std::vector<uint8_t>& m_output;
+    uint64_t m_bits = 0;
+    uint32_t m_bitCount = 0;
+};
+
+void WriteLiteral(BitWriter& writer, uint32_t symbol)
+{
+    auto const& code = FixedLiteralCodes[symbol];
+    writer.Write(code.Code, code.BitCount);
+}
+
+void WriteMatch(BitWriter& writer, uint32_t length, uint32_t distance)
+{
+    auto lengthIndex = static_cast<uint32_t>(std::upper_bound(LengthBases.begin(), LengthBases.end(), length) - LengthBases.begin()) - 1;
+    WriteLiteral(writer, 257 + lengthIndex);
+    writer.Write(length - LengthBases[lengthIndex], LengthExtraBits[lengthIndex]);
+
+    auto distanceIndex = static_cast<uint32_t>(std::upper_bound(DistanceBases.begin(), DistanceBases.end(), distance) - DistanceBases.begin()) - 1;
+    // Fixed distance codes are all 5 bits
+    writer.Write(ReverseBits(distanceIndex, 5), 5);
+    writer.Write(distance - DistanceBases[distanceIndex], DistanceExtraBits[distanceIndex]);
+}
+
+uint32_t HashAt(uint8_t const* data)
+{
+    auto value = (static_cast<uint32_t>(data[0]) << 16) | (static_cast<uint32_t>(data[1]) << 8) | data[2];
+    return (value * 2654435761u) >> (32 - HashBits);
+}
+
+std::vector<uint8_t> DeflateBlocks(uint8_t const* data, size_t size)
+{
+    std::vector<uint8_t> output;
+    output.reserve(size / 4 + 64);
+    BitWriter writer(output);
+
+    // BFINAL = 0, BTYPE = 01 (fixed Huffman)
+    writer.Write(0, 1);
+    writer.Write(1, 2);
+
+    std::vector<int64_t> head(static_cast<size_t>(1) << HashBits, -1);
+    std::vector<int64_t> previous(WindowSize, -1);
+    auto insert = [&](size_t position)
+    {
+        auto hash = HashAt(data + position);
+        previous[position & (WindowSize - 1)] = head[hash];
+        head[hash] = static_cast<int64_t>(position);
+    };
+
+    size_t position = 0;
+    while (position < size)
+    {
+        uint32_t bestLength = 0;
+        uint32_t bestDistance = 0;
+        if (position + MinMatch <= size)
+        {
+            auto maxLength = static_cast<uint32_t>(std::min<size_t>(MaxMatch, size - position));
+            auto candidate = head[HashAt(data + position)];
+            auto chainLength = MaxChainLength;
+            while (candidate >= 0 && chainLength-- > 0)
+            {
+                auto distance = position - static_cast<size_t>(candidate);
+                if (distance >= WindowSize)
+                {
+                    break;
+                }
+
+                auto match = data + candidate;
+                if (match[bestLength] == data[position + bestLength])
+                {
+                    uint32_t length = 0;
+                    while (length < maxLength && match[length] == data[position + length])
+                    {
+                        length++;
+                    }
+                    if (length > bestLength)
+                    {
+                        bestLength = length;
+                        bestDistance = static_cast<uint32_t>(distance);
+                        if (length == maxLength)
+                        {
+                            break;
+                        }
+                    }
+                }
+
+                // Entries older than the window may have been overwritten
+                auto next = previous[static_cast<size_t>(candidate) & (WindowSize - 1)];
+                if (next >= candidate)
+                {
+                    break;
+                }
+                candidate = next;
+            }
+            insert(position);
+        }
+
+        if (bestLength >= MinMatch)
+        {
+            WriteMatch(writer, bestLength, bestDistance);
+            for (auto i = 1u; i < bestLength; i++)
+            {
+                if (position + i + MinMatch <= size)
+                {
+                    insert(position + i);
+                }
+            }
+            position += bestLength;
+        }
+        else
+        {
+            WriteLiteral(writer, data[position]);
+            position++;
+        }
+    }
+
+    // End of block
+    WriteLiteral(writer, 256);
+
+    // Sync flush: an empty stored block leaves us byte aligned
+    writer.Write(0, 1);
+    writer.Write(0, 2);
+    writer.AlignToByte();
+    writer.Write(0x0000, 16);
+    writer.Write(0xFFFF, 16);
+
+    return output;
+}
+
+uint32_t Adler32(uint8_t const* data, size_t size, uint32_t adler)
+{
+    // The largest run we can sum before the 32-bit sums could overflow
+    const size_t maxRun = 5552;
+
+    uint32_t sum1 = adler & 0xFFFF;
+    uint32_t sum2 = adler >> 16;
+    while (size > 0)
+    {
+        auto run = std::min(size, maxRun);
+        size -= run;
+        for (auto i = 0u; i < run; i++)
+        {
+            sum1 += data[i];
+            sum2 += sum1;
+        }
+        data += run;
+        sum1 %= AdlerBase;
+        sum2 %= AdlerBase;
+    }
+    return (sum2 << 16) | sum1;
+}
+
+uint32_t Adler32Combine(uint32_t adler1, uint32_t adler2, size_t size2)
+{
+    // Same as zlib's adler32_combine
+    auto remainder = static_cast<uint32_t>(size2 % AdlerBase);
+    auto sum1 = adler1 & 0xFFFF;
+    auto sum2 = static_cast<uint32_t>((static_cast<uint64_t>(remainder) * sum1) % AdlerBase);
+    sum1 += (adler2 & 0xFFFF) + AdlerBase - 1;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + AdlerBase - remainder;
+    if (sum1 >= AdlerBase) sum1 -= AdlerBase;
+    if (sum1 >= AdlerBase) sum1 -= AdlerBase;
+    if (sum2 >= (AdlerBase << 1)) sum2 -= (AdlerBase << 1);
+    if (sum2 >= AdlerBase) sum2 -= AdlerBase;
+    return (sum2 << 16) | sum1;
+}
+
+std::array<uint8_t, 2> ZlibHeader()
+{
+    // Deflate with a 32K window, no preset dictionary, fastest compression
+    return { 0x78, 0x01 };
+}
+
+std::array<uint8_t, 6> ZlibFinish(uint32_t adler)
+{
+    return
+    {
+        // BFINAL = 1, BTYPE = 01, end of block
+        0x03, 0x00,
+        static_cast<uint8_t>(adler >> 24),
+        static_cast<uint8_t>(adler >> 16),
+        static_cast<uint8_t>(adler >> 8),
+        static_cast<uint8_t>(adler),
+    };
+}
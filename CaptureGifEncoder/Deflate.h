@@ -0,0 +1,23 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A small deflate encoder (RFC 1951) for our PNG output. It only emits
+// fixed Huffman blocks, which works well for screen content where most of
+// the savings come from long LZ77 matches.
+//
+// Pieces from DeflateBlocks end with a sync flush and are never marked
+// final, so pieces compressed independently (and in parallel) can be
+// concatenated into one zlib stream:
+//   ZlibHeader, piece0, piece1, ..., ZlibFinish(Adler32Combine(...))
+
+std::vector<uint8_t> DeflateBlocks(uint8_t const* data, size_t size);
+
+uint32_t Adler32(uint8_t const* data, size_t size, uint32_t adler = 1);
+uint32_t Adler32Combine(uint32_t adler1, uint32_t adler2, size_t size2);
+
+std::array<uint8_t, 2> ZlibHeader();
+// The final (empty) block followed by the checksum
+std::array<uint8_t, 6> ZlibFinish(uint32_t adler);
@@ -0,0 +1,24 @@
+#pragma once
+
+// Serializes use of the immediate context between capture targets that
+// share a D3D device. The device must be multithread protected.
+class DeviceLock
+{
+public:
+    DeviceLock(winrt::com_ptr<ID3D11Multithread> const& multithread)
+    {
+        m_multithread = multithread;
+        m_multithread->Enter();
+    }
+
+    ~DeviceLock()
+    {
+        m_multithread->Leave();
+    }
+
+    DeviceLock(DeviceLock const&) = delete;
+    DeviceLock& operator=(DeviceLock const&) = delete;
+
+private:
+    winrt::com_ptr<ID3D11Multithread> m_multithread;
+};
@@ -0,0 +1,193 @@
+#include "pch.h"
+#include "EncoderThreadPool.h"
+
+EncoderQueue::EncoderQueue(EncoderThreadPool* pool, size_t homeWorker)
+{
+    m_pool = pool;
+    m_homeWorker = homeWorker;
+}
+
+void EncoderQueue::Submit(std::function<void()> task)
+{
+    auto schedule = false;
+    {
+        std::lock_guard lock(m_lock);
+        m_tasks.push_back(std::move(task));
+        if (!m_scheduled)
+        {
+            m_scheduled = true;
+            schedule = true;
+        }
+    }
+
+    // Only one worker may own a queue at a time, which is what keeps
+    // our tasks in order.
+    if (schedule)
+    {
+        m_pool->Schedule(shared_from_this(), m_homeWorker);
+    }
+}
+
+void EncoderQueue::Wait()
+{
+    std::unique_lock lock(m_lock);
+    m_idle.wait(lock, [&]() { return !m_scheduled; });
+}
+
+void EncoderQueue::Flush()
+{
+    Wait();
+
+    std::exception_ptr error;
+    {
+        std::lock_guard lock(m_lock);
+        std::swap(error, m_error);
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+bool EncoderQueue::RunOne()
+{
+    std::function<void()> task;
+    {
+        std::lock_guard lock(m_lock);
+        task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+    }
+
+    try
+    {
+        task();
+    }
+    catch (...)
+    {
+        std::lock_guard lock(m_lock);
+        if (!m_error)
+        {
+            m_error = std::current_exception();
+        }
+    }
+
+    std::lock_guard lock(m_lock);
+    if (m_tasks.empty())
+    {
+        m_scheduled = false;
+        m_idle.notify_all();
+        return false;
+    }
+    return true;
+}
+
+EncoderThreadPool::EncoderThreadPool(uint32_t threadCount)
+{
+    threadCount = std::max(threadCount, 1u);
+    for (auto i = 0u; i < threadCount; i++)
+    {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    // Don't start any threads until all workers exist, otherwise
+    // an early thread may try to steal from a worker that isn't there.
+    for (auto i = 0u; i < threadCount; i++)
+    {
+        m_workers[i]->Thread = std::thread([this, i]() { WorkerLoop(i); });
+    }
+}
+
+EncoderThreadPool::~EncoderThreadPool()
+{
+    {
+        std::lock_guard lock(m_wakeLock);
+        m_stopping = true;
+    }
+    m_wakeCondition.notify_all();
+
+    for (auto&& worker : m_workers)
+    {
+        worker->Thread.join();
+    }
+}
+
+std::shared_ptr<EncoderQueue> EncoderThreadPool::CreateQueue()
+{
+    auto homeWorker = m_nextHomeWorker++ % m_workers.size();
+    return std::make_shared<EncoderQueue>(this, homeWorker);
+}
+
+void EncoderThreadPool::Schedule(std::shared_ptr<EncoderQueue> const& queue, size_t worker)
+{
+    {
+        auto& target = *m_workers[worker % m_workers.size()];
+        std::lock_guard lock(target.Lock);
+        target.ReadyQueues.push_back(queue);
+    }
+    {
+        std::lock_guard lock(m_wakeLock);
+        m_readyCount++;
+    }
+    m_wakeCondition.notify_one();
+}
+
+std::shared_ptr<EncoderQueue> EncoderThreadPool::TakeReadyQueue(size_t worker)
+{
+    // The caller has already reserved one ready queue, so one of the
+    // workers is guaranteed to have it.
+    while (true)
+    {
+        {
+            auto& self = *m_workers[worker];
+            std::lock_guard lock(self.Lock);
+            if (!self.ReadyQueues.empty())
+            {
+                auto queue = self.ReadyQueues.front();
+                self.ReadyQueues.pop_front();
+                return queue;
+            }
+        }
+
+        // Steal from the back of someone else's line
+        for (auto i = 1u; i < m_workers.size(); i++)
+        {
+            auto& victim = *m_workers[(worker + i) % m_workers.size()];
+            std::lock_guard lock(victim.Lock);
+            if (!victim.ReadyQueues.empty())
+            {
+                auto queue = victim.ReadyQueues.back();
+                victim.ReadyQueues.pop_back();
+                return queue;
+            }
+        }
+
+        std::this_thread::yield();
+    }
+}
+
+void EncoderThreadPool::WorkerLoop(size_t worker)
+{
+    // Our tasks talk to WIC
+    winrt::init_apartment(winrt::apartment_type::multi_threaded);
+
+    while (true)
+    {
+        {
+            std::unique_lock lock(m_wakeLock);
+            m_wakeCondition.wait(lock, [&]() { return m_readyCount > 0 || m_stopping; });
+            if (m_readyCount == 0)
+            {
+                break;
+            }
+            m_readyCount--;
+        }
+
+        auto queue = TakeReadyQueue(worker);
+        if (queue->RunOne())
+        {
+            // Go to the back of the line so that other sources get a turn
+            Schedule(queue, worker);
+        }
+    }
+
+    winrt::uninit_apartment();
+}
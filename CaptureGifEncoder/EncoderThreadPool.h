@@ -0,0 +1,68 @@
+#pragma once
+
+class EncoderThreadPool;
+
+// Tasks submitted to a queue run one at a time and in order, but
+// tasks from different queues run concurrently on the pool.
+class EncoderQueue : public std::enable_shared_from_this<EncoderQueue>
+{
+public:
+    EncoderQueue(EncoderThreadPool* pool, size_t homeWorker);
+
+    void Submit(std::function<void()> task);
+    // Blocks until every submitted task has run.
+    void Wait();
+    // Like Wait, but rethrows the first exception thrown by a task.
+    void Flush();
+
+private:
+    friend class EncoderThreadPool;
+
+    // Runs the next task, returns true if more tasks are pending.
+    bool RunOne();
+
+private:
+    EncoderThreadPool* m_pool = nullptr;
+    size_t m_homeWorker = 0;
+    std::mutex m_lock;
+    std::condition_variable m_idle;
+    std::deque<std::function<void()>> m_tasks;
+    bool m_scheduled = false;
+    std::exception_ptr m_error;
+};
+
+// A work-stealing pool shared by every encoder in the process. Workers
+// schedule queues rather than tasks. After running a single task, a queue
+// with more work goes to the back of the line, so a busy source can't
+// starve the others.
+class EncoderThreadPool
+{
+public:
+    EncoderThreadPool(uint32_t threadCount);
+    ~EncoderThreadPool();
+
+    std::shared_ptr<EncoderQueue> CreateQueue();
+    size_t ThreadCount() { return m_workers.size(); }
+
+private:
+    friend class EncoderQueue;
+
+    struct Worker
+    {
+        std::mutex Lock;
+        std::deque<std::shared_ptr<EncoderQueue>> ReadyQueues;
+        std::thread Thread;
+    };
+
+    void Schedule(std::shared_ptr<EncoderQueue> const& queue, size_t worker);
+    std::shared_ptr<EncoderQueue> TakeReadyQueue(size_t worker);
+    void WorkerLoop(size_t worker);
+
+private:
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<size_t> m_nextHomeWorker = 0;
+    std::mutex m_wakeLock;
+    std::condition_variable m_wakeCondition;
+    size_t m_readyCount = 0;
+    bool m_stopping = false;
+};
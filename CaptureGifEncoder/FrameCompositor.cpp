@@ -37,9 +37,14 @@ FrameCompositor::FrameCompositor(
 ComposedFrame FrameCompositor::ProcessFrame(winrt::Direct3D11CaptureFrame const& frame)
 {
     auto frameTexture = GetDXGIInterfaceFromObject<ID3D11Texture2D>(frame.Surface());
-    auto systemRelativeTime = frame.SystemRelativeTime();
-    auto contentSize = frame.ContentSize();
+    return ProcessFrame(frameTexture, frame.ContentSize(), frame.SystemRelativeTime());
+}
 
+ComposedFrame FrameCompositor::ProcessFrame(
+    winrt::com_ptr<ID3D11Texture2D> const& frameTexture,
+    winrt::SizeInt32 contentSize,
+    winrt::Windows::Foundation::TimeSpan systemRelativeTime)
+{
     D3D11_TEXTURE2D_DESC desc = {};
     frameTexture->GetDesc(&desc);
 
@@ -64,6 +69,7 @@ ComposedFrame FrameCompositor::ProcessFrame(winrt::Direct3D11CaptureFrame const&
     ComposedFrame composedFrame = {};
     composedFrame.Texture = m_outputTexture;
     composedFrame.SystemRelativeTime = systemRelativeTime;
+    composedFrame.Overlay = m_overlay;
     return composedFrame;
 }
 
@@ -72,5 +78,6 @@ ComposedFrame FrameCompositor::RepeatFrame(winrt::Windows::Foundation::TimeSpan
     ComposedFrame composedFrame = {};
     composedFrame.Texture = m_outputTexture;
     composedFrame.SystemRelativeTime = systemRelativeTime;
+    composedFrame.Overlay = m_overlay;
     return composedFrame;
 }
@@ -1,9 +1,13 @@
 #pragma once
+#include "OverlayBlend.h"
 
 struct ComposedFrame
 {
     winrt::com_ptr<ID3D11Texture2D> Texture;
     winrt::Windows::Foundation::TimeSpan SystemRelativeTime = {};
+    // Drawn over the texture when the frame is read back, which keeps it
+    // out of the texture diff.
+    std::optional<OverlayPlacement> Overlay;
 };
 
 class FrameCompositor
@@ -15,10 +19,16 @@ public:
         winrt::Windows::Graphics::SizeInt32 frameSize);
 
     ComposedFrame ProcessFrame(winrt::Windows::Graphics::Capture::Direct3D11CaptureFrame const& frame);
+    ComposedFrame ProcessFrame(
+        winrt::com_ptr<ID3D11Texture2D> const& frameTexture,
+        winrt::Windows::Graphics::SizeInt32 contentSize,
+        winrt::Windows::Foundation::TimeSpan systemRelativeTime);
     ComposedFrame RepeatFrame(winrt::Windows::Foundation::TimeSpan systemRelativeTime);
+    void SetOverlay(std::optional<OverlayPlacement> const& overlay) { m_overlay = overlay; }
 
 private:
     winrt::com_ptr<ID3D11DeviceContext> m_d3dContext;
     winrt::com_ptr<ID3D11Texture2D> m_outputTexture;
     winrt::com_ptr<ID3D11RenderTargetView> m_outputRTV;
+    std::optional<OverlayPlacement> m_overlay;
 };
\ No newline at end of file
@@ -0,0 +1,41 @@
+#include "pch.h"
+#include "FrameWriter.h"
+#include "GifFrameWriter.h"
+#include "ApngFrameWriter.h"
+
+namespace winrt
+{
+    using namespace Windows::Graphics;
+    using namespace Windows::Storage::Streams;
+}
+
+std::unique_ptr<FrameWriter> CreateFrameWriter(
+    OutputFormat format,
+    winrt::com_ptr<IWICImagingFactory2> const& wicFactory,
+    winrt::IRandomAccessStream const& stream,
+    winrt::SizeInt32 size,
+    std::shared_ptr<EncoderThreadPool> const& threadPool)
+{
+    switch (format)
+    {
+    case OutputFormat::Gif:
+        return std::make_unique<GifFrameWriter>(wicFactory, stream);
+    case OutputFormat::Apng:
+        return std::make_unique<ApngFrameWriter>(stream, size, threadPool);
+    default:
+        throw winrt::hresult_invalid_argument(L"Unknown output format!");
+    }
+}
+
+std::wstring GetFileExtension(OutputFormat format)
+{
+    switch (format)
+    {
+    case OutputFormat::Gif:
+        return L".gif";
+    case OutputFormat::Apng:
+        return L".png";
+    default:
+        throw winrt::hresult_invalid_argument(L"Unknown output format!");
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "DiffRect.h"
+#include "PixelBuffer.h"
+#include "EncoderThreadPool.h"
+
+enum class OutputFormat
+{
+    Gif,
+    Apng,
+};
+
+// Writes the sub-frames produced by the encoder to an output file. Each
+// frame covers Rect on the canvas and stays on screen for its delay.
+// Pixels with zero alpha are the same as in the previous frame.
+class FrameWriter
+{
+public:
+    virtual ~FrameWriter() {}
+
+    // Called in frame order, one at a time, from the encoder's queue
+    virtual void WriteFrame(std::shared_ptr<PixelBuffer> const& pixels, DiffRect const& rect, std::chrono::milliseconds delay) = 0;
+    // Called once after every frame has been written
+    virtual void Commit() = 0;
+};
+
+std::unique_ptr<FrameWriter> CreateFrameWriter(
+    OutputFormat format,
+    winrt::com_ptr<IWICImagingFactory2> const& wicFactory,
+    winrt::Windows::Storage::Streams::IRandomAccessStream const& stream,
+    winrt::Windows::Graphics::SizeInt32 size,
+    std::shared_ptr<EncoderThreadPool> const& threadPool);
+
+std::wstring GetFileExtension(OutputFormat format);
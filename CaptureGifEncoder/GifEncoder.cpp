@@ -1,206 +1,490 @@
 #include "pch.h"
 #include "GifEncoder.h"
+#include "DeviceLock.h"
 
 namespace winrt
 {
     using namespace Windows::Graphics;
     using namespace Windows::Graphics::Capture;
-    using namespace Windows::Storage::Streams;
 }
 
-namespace util
-{
-    using namespace robmikh::common::uwp;
-}
+// Parts are copied once their diff is known, which is already a frame or
+// two behind, so one copy in flight while we read another is plenty.
+const uint32_t RegionReadbackSlots = 2;
+// We encode at most 30fps
+const std::chrono::milliseconds MinFrameInterval(33);
+// The capture session counts as idle once it's been this long since its
+// last frame, at which point the overlay has to repeat frames on its own
+const std::chrono::milliseconds OverlayIdleTime(66);
 
 GifEncoder::GifEncoder(
     winrt::com_ptr<ID3D11Device> const& d3dDevice, 
     winrt::com_ptr<ID3D11DeviceContext> const& d3dContext,
-    winrt::com_ptr<ID2D1Device> const& d2dDevice,
-    winrt::com_ptr<IWICImagingFactory2> const& wicFactory,
-    winrt::IRandomAccessStream const& stream,
-    winrt::SizeInt32 gifSize)
+    std::unique_ptr<FrameWriter> frameWriter,
+    winrt::SizeInt32 gifSize,
+    std::shared_ptr<EncoderThreadPool> const& threadPool,
+    std::shared_ptr<PixelBufferPool> const& bufferPool)
 {
     m_gifSize = gifSize;
     m_d3dDevice = d3dDevice;
-    winrt::check_hresult(d2dDevice->CreateDeviceContext(D2D1_DEVICE_CONTEXT_OPTIONS_NONE, m_d2dContext.put()));
-    auto abiStream = util::CreateStreamFromRandomAccessStream(stream);
-
-    // Setup WIC to encode a gif
-    winrt::check_hresult(wicFactory->CreateEncoder(GUID_ContainerFormatGif, nullptr, m_encoder.put()));
-    winrt::check_hresult(m_encoder->Initialize(abiStream.get(), WICBitmapEncoderNoCache));
-    winrt::check_hresult(wicFactory->CreateImageEncoder(d2dDevice.get(), m_imageEncoder.put()));
-
-    // Write the application block
-    // http://www.vurdalakov.net/misc/gif/netscape-looping-application-extension
-    winrt::com_ptr<IWICMetadataQueryWriter> metadata;
-    winrt::check_hresult(m_encoder->GetMetadataQueryWriter(metadata.put()));
-    {
-        PROPVARIANT value = {};
-        value.vt = VT_UI1 | VT_VECTOR;
-        value.caub.cElems = 11;
-        std::string text("NETSCAPE2.0");
-        std::vector<uint8_t> chars(text.begin(), text.end());
-        WINRT_VERIFY(chars.size() == 11);
-        value.caub.pElems = chars.data();
-        winrt::check_hresult(metadata->SetMetadataByName(L"/appext/application", &value));
-    }
-    {
-        PROPVARIANT value = {};
-        value.vt = VT_UI1 | VT_VECTOR;
-        value.caub.cElems = 5;
-        // The first value is the size of the block, which is the fixed value 3.
-        // The second value is the looping extension, which is the fixed value 1.
-        // The third and fourth values comprise an unsigned 2-byte integer (little endian).
-        //     The value of 0 means to loop infinitely.
-        // The final value is the block terminator, which is the fixed value 0.
-        std::vector<uint8_t> data({ 3, 1, 0, 0, 0 });
-        value.caub.pElems = data.data();
-        winrt::check_hresult(metadata->SetMetadataByName(L"/appext/data", &value));
-    }
+    m_d3dContext = d3dContext;
+    m_d3dMultithread = d3dContext.as<ID3D11Multithread>();
+    m_frameWriter = std::move(frameWriter);
+    m_encodeQueue = threadPool->CreateQueue();
+    m_bufferPool = bufferPool;
 
     // Setup our frame compositor and texture differ
     m_frameCompositor = std::make_unique<FrameCompositor>(d3dDevice, d3dContext, gifSize);
     m_textureDiffer = std::make_unique<TextureDiffer>(d3dDevice, d3dContext, gifSize);
+    m_regionReadbacks = std::make_unique<RegionReadbackRing>(RegionReadbackDevice(d3dDevice, d3dContext, gifSize, RegionReadbackSlots), RegionReadbackSlots);
+
+    // A copy of the last frame we read back, used to find unchanged pixels
+    m_canvas.Width = static_cast<uint32_t>(gifSize.Width);
+    m_canvas.Height = static_cast<uint32_t>(gifSize.Height);
+    m_canvas.Stride = m_canvas.Width * 4;
+    m_canvas.Data.resize(static_cast<size_t>(m_canvas.Stride) * m_canvas.Height);
+}
+
+GifEncoder::~GifEncoder()
+{
+    // Our pending tasks reference us
+    m_encodeQueue->Wait();
 }
 
 bool GifEncoder::ProcessFrame(winrt::Direct3D11CaptureFrame const& frame)
 {
-    auto timeStamp = frame.SystemRelativeTime();
+    auto frameTexture = GetDXGIInterfaceFromObject<ID3D11Texture2D>(frame.Surface());
+    return ProcessFrame(frameTexture, frame.ContentSize(), frame.SystemRelativeTime());
+}
 
-    auto firstFrame = false;
+bool GifEncoder::ProcessFrame(
+    winrt::com_ptr<ID3D11Texture2D> const& frameTexture,
+    winrt::SizeInt32 contentSize,
+    winrt::Windows::Foundation::TimeSpan systemRelativeTime)
+{
+    std::lock_guard frameLock(m_lock);
+    auto timeStamp = systemRelativeTime;
+    m_lastCaptureTimeStamp = timeStamp;
 
-    // Compute frame delta
-    if (m_lastTimeStamp.count() == 0)
+    // Only other capture frames count toward the throttle. Overlay repeats
+    // are stamped with the time they were made, which can be after this
+    // frame was captured, so rather than drop the frame we move it to
+    // after the repeat.
+    if (ShouldThrottle(timeStamp, m_lastCaptureSubmittedTimeStamp))
     {
-        m_lastTimeStamp = timeStamp;
-        firstFrame = true;
+        return false;
+    }
+    m_lastCaptureSubmittedTimeStamp = timeStamp;
+    if (m_lastSubmittedTimeStamp.count() != 0)
+    {
+        timeStamp = std::max<winrt::Windows::Foundation::TimeSpan>(timeStamp, m_lastSubmittedTimeStamp + MinFrameInterval);
     }
-    auto timeStampDelta = timeStamp - m_lastTimeStamp;
 
-    // Throttle frame processing to 30fps
-    if (!firstFrame && timeStampDelta < std::chrono::milliseconds(33))
+    {
+        DeviceLock lock(m_d3dMultithread);
+        auto composedFrame = m_frameCompositor->ProcessFrame(frameTexture, contentSize, timeStamp);
+        SubmitFrame(composedFrame, false);
+    }
+    EncodeReadFrames();
+
+    return true;
+}
+
+void GifEncoder::SetOverlay(std::optional<OverlayPlacement> const& overlay)
+{
+    std::lock_guard frameLock(m_lock);
+    m_frameCompositor->SetOverlay(overlay);
+}
+
+bool GifEncoder::ProcessOverlay(
+    std::optional<OverlayPlacement> const& overlay,
+    winrt::Windows::Foundation::TimeSpan systemRelativeTime)
+{
+    std::lock_guard frameLock(m_lock);
+
+    // An overlay that misses the frame is the same as none, so moving it
+    // around off the frame doesn't repeat frames that change nothing
+    auto visibleOverlay = overlay;
+    if (overlay.has_value() && !GetOverlayRect(*overlay, static_cast<uint32_t>(m_gifSize.Width), static_cast<uint32_t>(m_gifSize.Height)).has_value())
+    {
+        visibleOverlay = std::nullopt;
+    }
+    m_frameCompositor->SetOverlay(visibleOverlay);
+
+    // There's nothing to repeat until the first frame shows up. While the
+    // capture session is sending frames, the next one picks up the overlay.
+    auto timeStamp = systemRelativeTime;
+    if (m_lastSubmittedTimeStamp.count() == 0 ||
+        visibleOverlay == m_submittedOverlay ||
+        timeStamp - m_lastCaptureTimeStamp < OverlayIdleTime ||
+        ShouldThrottle(timeStamp, m_lastSubmittedTimeStamp))
     {
         return false;
     }
-    m_lastCandidateTimeStamp = timeStamp;
 
-    auto composedFrame = m_frameCompositor->ProcessFrame(frame);
+    {
+        DeviceLock lock(m_d3dMultithread);
+        auto composedFrame = m_frameCompositor->RepeatFrame(timeStamp);
+        SubmitFrame(composedFrame, false);
+    }
+    EncodeReadFrames();
 
-    return ProcessFrame(composedFrame, false);
+    return true;
 }
 
 void GifEncoder::StopEncoding()
 {
     // Repeat the last frame
-    auto composedFrame = m_frameCompositor->RepeatFrame(m_lastCandidateTimeStamp);
-    ProcessFrame(composedFrame, true);
+    {
+        std::lock_guard frameLock(m_lock);
+        {
+            DeviceLock lock(m_d3dMultithread);
+
+            // The overlay may have moved since the capture session went
+            // quiet, and the forced frame is never shown
+            if (m_lastSubmittedTimeStamp.count() != 0)
+            {
+                auto overlayFrame = m_frameCompositor->RepeatFrame(m_lastSubmittedTimeStamp + MinFrameInterval);
+                if (overlayFrame.Overlay != m_submittedOverlay)
+                {
+                    SubmitFrame(overlayFrame, false);
+                }
+            }
+
+            auto composedFrame = m_frameCompositor->RepeatFrame(m_lastSubmittedTimeStamp);
+            SubmitFrame(composedFrame, true);
+
+            // Nothing else is coming, so wait on the rest of the readbacks
+            while (auto readback = m_textureDiffer->WaitResult([this]() { YieldDevice(); }))
+            {
+                ProcessDiffReadback(*readback);
+            }
+            while (auto readback = m_regionReadbacks->Wait([this]() { YieldDevice(); }))
+            {
+                ProcessRegionReadback(*readback);
+            }
+        }
+        EncodeReadFrames();
+    }
+
+    // Wait for our frames before finishing the file. The commit happens
+    // on this thread since the writer may wait on the pool itself.
+    m_encodeQueue->Flush();
+    m_frameWriter->Commit();
+}
 
-    winrt::check_hresult(m_encoder->Commit());
+bool GifEncoder::ShouldThrottle(winrt::Windows::Foundation::TimeSpan timeStamp, winrt::Windows::Foundation::TimeSpan lastTimeStamp)
+{
+    // Throttle frame processing to 30fps. Whether a frame changed anything
+    // isn't known until its diff comes back, so we measure from frames we
+    // submitted rather than the last one we encoded.
+    auto firstFrame = lastTimeStamp.count() == 0;
+    return !firstFrame && timeStamp - lastTimeStamp < MinFrameInterval;
 }
 
-bool GifEncoder::ProcessFrame(ComposedFrame const& composedFrame, bool force)
+void GifEncoder::YieldDevice()
 {
-    bool updated = false;
+    // Every caller holds exactly one DeviceLock, so this really lets go of
+    // the device. Other encoders can use it while we wait on the GPU, and
+    // nothing of ours is left half done on the context in between.
+    m_d3dMultithread->Leave();
+    std::this_thread::yield();
+    m_d3dMultithread->Enter();
+}
 
-    auto diff = m_textureDiffer->ProcessFrame(composedFrame.Texture);
-    if (force && !diff.has_value())
+void GifEncoder::SubmitFrame(ComposedFrame const& composedFrame, bool force)
+{
+    // Handle any readbacks that have come back, only waiting if every
+    // diff slot is still in use.
+    while (auto readback = m_regionReadbacks->Poll())
+    {
+        ProcessRegionReadback(*readback);
+    }
+    while (auto readback = m_textureDiffer->PollResult())
+    {
+        ProcessDiffReadback(*readback);
+    }
+    if (m_textureDiffer->IsFull())
+    {
+        ProcessDiffReadback(*m_textureDiffer->WaitResult([this]() { YieldDevice(); }));
+    }
+
+    m_lastSubmittedTimeStamp = composedFrame.SystemRelativeTime;
+    if (m_lastTimeStamp.count() == 0)
+    {
+        m_lastTimeStamp = m_lastSubmittedTimeStamp;
+    }
+
+    PendingFrame pendingFrame = {};
+    pendingFrame.Sequence = m_textureDiffer->SubmitFrame(composedFrame.Texture);
+    pendingFrame.SystemRelativeTime = composedFrame.SystemRelativeTime;
+    pendingFrame.Overlay = composedFrame.Overlay;
+    m_submittedOverlay = composedFrame.Overlay;
+    pendingFrame.Force = force;
+    m_pendingFrames.push_back(pendingFrame);
+}
+
+void GifEncoder::ProcessDiffReadback(DiffReadbackRing::Readback const& readback)
+{
+    auto pendingFrame = m_pendingFrames.front();
+    m_pendingFrames.pop_front();
+    WINRT_ASSERT(pendingFrame.Sequence == readback.Sequence);
+    auto force = pendingFrame.Force;
+
+    // The base content and the overlay are tracked separately, so moving
+    // the cursor only touches where it was and where it is now.
+    std::vector<DiffRect> parts;
+    if (pendingFrame.Overlay != m_lastOverlay)
+    {
+        for (auto&& overlay : { m_lastOverlay, pendingFrame.Overlay })
+        {
+            if (overlay.has_value())
+            {
+                if (auto overlayRect = GetOverlayRect(*overlay, static_cast<uint32_t>(m_gifSize.Width), static_cast<uint32_t>(m_gifSize.Height)))
+                {
+                    parts.push_back(*overlayRect);
+                }
+            }
+        }
+        m_lastOverlay = pendingFrame.Overlay;
+    }
+
+    auto diff = readback.Value.Rect;
+    if (force && !diff.has_value() && parts.empty())
     {
         // Since there's no change, pick a small random part of the frame.
         diff = std::optional(DiffRect{ 0, 0, 5, 5 });
     }
-
     if (auto diffRect = diff)
     {
-        auto timeStampDelta = composedFrame.SystemRelativeTime - m_lastTimeStamp;
-        m_lastTimeStamp = composedFrame.SystemRelativeTime;
-
         // Inflate our rect to eliminate artifacts
         auto inflateAmount = 1;
         auto left = static_cast<uint32_t>(std::max(static_cast<int32_t>(diffRect->Left) - inflateAmount, 0));
         auto top = static_cast<uint32_t>(std::max(static_cast<int32_t>(diffRect->Top) - inflateAmount, 0));
         auto right = static_cast<uint32_t>(std::min(static_cast<int32_t>(diffRect->Right) + inflateAmount, m_gifSize.Width));
         auto bottom = static_cast<uint32_t>(std::min(static_cast<int32_t>(diffRect->Bottom) + inflateAmount, m_gifSize.Height));
+        parts.push_back(DiffRect{ left, top, right, bottom });
+    }
+
+    if (!parts.empty())
+    {
+        auto timeStampDelta = pendingFrame.SystemRelativeTime - m_lastTimeStamp;
+        m_lastTimeStamp = pendingFrame.SystemRelativeTime;
 
         // Create the frame
-        auto textureCopy = util::CopyD3DTexture(m_d3dDevice, composedFrame.Texture, false);
-        auto frame = std::make_shared<GifFrameImage>(textureCopy, DiffRect { left, top, right, bottom }, composedFrame.SystemRelativeTime);
+        auto rect = parts[0];
+        for (auto&& part : parts)
+        {
+            rect.Left = std::min(rect.Left, part.Left);
+            rect.Top = std::min(rect.Top, part.Top);
+            rect.Right = std::max(rect.Right, part.Right);
+            rect.Bottom = std::max(rect.Bottom, part.Bottom);
+        }
+
+        // Only the parts that changed leave the GPU. Make room for them
+        // the same way SubmitFrame does.
+        while (auto regions = m_regionReadbacks->Poll())
+        {
+            ProcessRegionReadback(*regions);
+        }
+        if (m_regionReadbacks->IsFull())
+        {
+            ProcessRegionReadback(*m_regionReadbacks->Wait([this]() { YieldDevice(); }));
+        }
 
-        // Encode the frame
+        PendingRead pendingRead = {};
+        pendingRead.Sequence = m_regionReadbacks->Submit(readback.Value.Frame, parts);
+        pendingRead.Rect = rect;
+        pendingRead.Parts = std::move(parts);
+        pendingRead.Overlay = pendingFrame.Overlay;
+        pendingRead.SystemRelativeTime = pendingFrame.SystemRelativeTime;
+        pendingRead.TimeStampDelta = timeStampDelta;
+        pendingRead.Force = force;
+        m_pendingReads.push_back(std::move(pendingRead));
+    }
+}
+
+void GifEncoder::ProcessRegionReadback(RegionReadbackRing::Readback const& readback)
+{
+    auto pendingRead = std::move(m_pendingReads.front());
+    m_pendingReads.pop_front();
+    WINRT_ASSERT(pendingRead.Sequence == readback.Sequence);
+
+    // Only the copy needs the device. Everything else waits for
+    // EncodeReadFrames so that other encoders can use it meanwhile.
+    pendingRead.Pixels = ReadPixels(readback.Value, pendingRead.Rect, pendingRead.Parts);
+    m_readFrames.push_back(std::move(pendingRead));
+}
+
+void GifEncoder::EncodeReadFrames()
+{
+    for (auto&& readFrame : m_readFrames)
+    {
+        auto force = readFrame.Force;
+        auto rect = readFrame.Rect;
+        auto pixels = readFrame.Pixels;
+        FinishPixels(readFrame);
+        auto reusedPixels = ReuseUnchangedPixels(*pixels, rect);
+
+        // The forced frame never gets encoded
+        if (!force)
+        {
+            auto encodedPixels = static_cast<uint64_t>(pixels->Width) * pixels->Height;
+            m_stats.FrameCount++;
+            m_stats.EncodedPixels += encodedPixels;
+            m_stats.ReusedPixels += reusedPixels;
+        }
+
+        auto frame = std::make_shared<GifFrameImage>(pixels, rect, readFrame.SystemRelativeTime);
+
+        // Encode the previous frame now that we know how long it was on screen
         m_previousFrame.swap(frame);
         if (frame != nullptr)
         {
-            auto currentTime = composedFrame.SystemRelativeTime;
+            auto currentTime = readFrame.SystemRelativeTime;
             if (force)
             {
-                currentTime += timeStampDelta;
+                currentTime += readFrame.TimeStampDelta;
+            }
+            m_encodeQueue->Submit([this, frame, currentTime]()
+            {
+                EncodeFrame(frame, currentTime);
+            });
+        }
+    }
+    m_readFrames.clear();
+}
+
+std::shared_ptr<PixelBuffer> GifEncoder::ReadPixels(
+    winrt::com_ptr<ID3D11Texture2D> const& stagingTexture,
+    DiffRect const& rect,
+    std::vector<DiffRect> const& parts)
+{
+    auto width = rect.Right - rect.Left;
+    auto height = rect.Bottom - rect.Top;
+    auto pixels = m_bufferPool->Acquire(width, height);
+
+    // The region ring has already waited for the copy, so this won't stall
+    D3D11_MAPPED_SUBRESOURCE mapped = {};
+    winrt::check_hresult(m_d3dContext->Map(stagingTexture.get(), 0, D3D11_MAP_READ, 0, &mapped));
+    auto unmap = wil::scope_exit([&]()
+    {
+        m_d3dContext->Unmap(stagingTexture.get(), 0);
+    });
+
+    auto source = reinterpret_cast<uint8_t const*>(mapped.pData);
+    for (auto&& part : parts)
+    {
+        auto partSize = static_cast<size_t>(part.Right - part.Left) * 4;
+        for (auto y = part.Top; y < part.Bottom; y++)
+        {
+            auto destination = pixels->Data.data() + static_cast<size_t>(y - rect.Top) * pixels->Stride + static_cast<size_t>(part.Left - rect.Left) * 4;
+            memcpy(destination, source + static_cast<size_t>(y) * mapped.RowPitch + static_cast<size_t>(part.Left) * 4, partSize);
+        }
+    }
+    return pixels;
+}
+
+void GifEncoder::FinishPixels(PendingRead const& readFrame)
+{
+    auto& pixels = *readFrame.Pixels;
+    auto rect = readFrame.Rect;
+    auto const& overlay = readFrame.Overlay;
+    if (readFrame.Parts.size() == 1)
+    {
+        if (overlay.has_value())
+        {
+            BlendOverlay(pixels, rect, rect, *overlay);
+        }
+        return;
+    }
+
+    // Anything between the parts hasn't changed, so it comes from the
+    // canvas, which already has the overlay drawn. Parts can overlap, so
+    // the overlay is drawn once over each row's merged spans.
+    std::vector<std::pair<uint32_t, uint32_t>> spans;
+    for (auto y = rect.Top; y < rect.Bottom; y++)
+    {
+        spans.clear();
+        for (auto&& part : readFrame.Parts)
+        {
+            if (part.Top <= y && y < part.Bottom)
+            {
+                spans.emplace_back(part.Left, part.Right);
             }
-            EncodeFrame(frame, currentTime);
         }
+        std::sort(spans.begin(), spans.end());
 
-        updated = true;
+        auto row = pixels.Data.data() + static_cast<size_t>(y - rect.Top) * pixels.Stride;
+        auto canvasRow = m_canvas.Data.data() + static_cast<size_t>(y) * m_canvas.Stride;
+        auto fillFromCanvas = [&](uint32_t left, uint32_t right)
+        {
+            memcpy(row + static_cast<size_t>(left - rect.Left) * 4, canvasRow + static_cast<size_t>(left) * 4, static_cast<size_t>(right - left) * 4);
+        };
+
+        auto x = rect.Left;
+        for (auto&& [left, right] : spans)
+        {
+            if (left > x)
+            {
+                fillFromCanvas(x, left);
+                x = left;
+            }
+            if (right > x)
+            {
+                if (overlay.has_value())
+                {
+                    BlendOverlay(pixels, rect, DiffRect{ x, y, right, y + 1 }, *overlay);
+                }
+                x = right;
+            }
+        }
+        if (rect.Right > x)
+        {
+            fillFromCanvas(x, rect.Right);
+        }
     }
+}
 
-    return updated;
+uint64_t GifEncoder::ReuseUnchangedPixels(PixelBuffer& pixels, DiffRect const& rect)
+{
+    // Pixels that match the previous frame get a zero alpha so that the
+    // writer can leave them transparent, everything else is made opaque.
+    // Either way the canvas picks up the new color.
+    const uint32_t colorMask = 0x00FFFFFF;
+    const uint32_t opaque = 0xFF000000;
+    uint64_t reusedPixels = 0;
+    for (auto y = 0u; y < pixels.Height; y++)
+    {
+        auto current = reinterpret_cast<uint32_t*>(pixels.Data.data() + static_cast<size_t>(y) * pixels.Stride);
+        auto canvas = reinterpret_cast<uint32_t*>(m_canvas.Data.data() + static_cast<size_t>(rect.Top + y) * m_canvas.Stride) + rect.Left;
+        for (auto x = 0u; x < pixels.Width; x++)
+        {
+            auto color = current[x] & colorMask;
+            auto unchanged = m_canvasValid && color == (canvas[x] & colorMask);
+            canvas[x] = color | opaque;
+            current[x] = unchanged ? color : color | opaque;
+            reusedPixels += unchanged ? 1 : 0;
+        }
+    }
+    m_canvasValid = true;
+    return reusedPixels;
 }
 
 void GifEncoder::EncodeFrame(std::shared_ptr<GifFrameImage> const& frame, winrt::Windows::Foundation::TimeSpan const& currentTime)
 {
-    auto diffWidth = frame->Rect.Right - frame->Rect.Left;
-    auto diffHeight = frame->Rect.Bottom - frame->Rect.Top;
-
     auto frameDuration = currentTime - frame->TimeStamp;
     // Compute the frame delay
     auto millisconds = std::chrono::duration_cast<std::chrono::milliseconds>(frameDuration);
-    // Use 10ms units
-    auto frameDelay = millisconds.count() / 10;
-
-    // Create a D2D bitmap
-    winrt::com_ptr<ID2D1Bitmap1> d2dBitmap;
-    winrt::check_hresult(m_d2dContext->CreateBitmapFromDxgiSurface(frame->Texture.as<IDXGISurface>().get(), nullptr, d2dBitmap.put()));
-
-    // Setup our WIC frame (note the matching pixel format)
-    winrt::com_ptr<IWICBitmapFrameEncode> wicFrame;
-    winrt::check_hresult(m_encoder->CreateNewFrame(wicFrame.put(), nullptr));
-    winrt::check_hresult(wicFrame->Initialize(nullptr));
-    auto wicPixelFormat = GUID_WICPixelFormat32bppBGRA;
-    winrt::check_hresult(wicFrame->SetPixelFormat(&wicPixelFormat));
-
-    // Write frame metadata
-    winrt::com_ptr<IWICMetadataQueryWriter> metadata;
-    winrt::check_hresult(wicFrame->GetMetadataQueryWriter(metadata.put()));
-    // Delay
-    {
-        PROPVARIANT delayValue = {};
-        delayValue.vt = VT_UI2;
-        delayValue.uiVal = static_cast<unsigned short>(frameDelay);
-        winrt::check_hresult(metadata->SetMetadataByName(L"/grctlext/Delay", &delayValue));
-    }
-    // Left
-    {
-        PROPVARIANT metadataValue = {};
-        metadataValue.vt = VT_UI2;
-        metadataValue.uiVal = static_cast<unsigned short>(frame->Rect.Left);
-        winrt::check_hresult(metadata->SetMetadataByName(L"/imgdesc/Left", &metadataValue));
-    }
-    // Top
-    {
-        PROPVARIANT metadataValue = {};
-        metadataValue.vt = VT_UI2;
-        metadataValue.uiVal = static_cast<unsigned short>(frame->Rect.Top);
-        winrt::check_hresult(metadata->SetMetadataByName(L"/imgdesc/Top", &metadataValue));
-    }
-
-    // Write the frame to our image (this must come after you write the metadata)
-    WICImageParameters frameParams = {};
-    frameParams.PixelFormat.format = DXGI_FORMAT_B8G8R8A8_UNORM;
-    frameParams.PixelFormat.alphaMode = D2D1_ALPHA_MODE_PREMULTIPLIED;
-    frameParams.DpiX = 96.0f;
-    frameParams.DpiY = 96.0f;
-    frameParams.Left = static_cast<float>(frame->Rect.Left);
-    frameParams.Top = static_cast<float>(frame->Rect.Top);
-    frameParams.PixelWidth = diffWidth;
-    frameParams.PixelHeight = diffHeight;
-    winrt::check_hresult(m_imageEncoder->WriteFrame(d2dBitmap.get(), wicFrame.get(), &frameParams));
-    winrt::check_hresult(wicFrame->Commit());
+
+    m_frameWriter->WriteFrame(frame->Pixels, frame->Rect, millisconds);
+}
+
+void PrintEncoderStats(EncoderStats const& stats)
+{
+    auto unchanged = stats.EncodedPixels > 0 ? (100.0 * stats.ReusedPixels) / stats.EncodedPixels : 0.0;
+    wprintf(L"  %llu frames, %llu pixels encoded, %.1f%% unchanged\n",
+        stats.FrameCount,
+        stats.EncodedPixels,
+        unchanged);
 }
@@ -1,6 +1,20 @@
 #pragma once
 #include "FrameCompositor.h"
 #include "TextureDiffer.h"
+#include "EncoderThreadPool.h"
+#include "PixelBufferPool.h"
+#include "FrameWriter.h"
+
+struct EncoderStats
+{
+    uint64_t FrameCount = 0;
+    // Area of the sub-frames we wrote
+    uint64_t EncodedPixels = 0;
+    // Pixels in those sub-frames that matched the previous frame
+    uint64_t ReusedPixels = 0;
+};
+
+void PrintEncoderStats(EncoderStats const& stats);
 
 class GifEncoder
 {
@@ -8,43 +22,111 @@ public:
     GifEncoder(
         winrt::com_ptr<ID3D11Device> const& d3dDevice,
         winrt::com_ptr<ID3D11DeviceContext> const& d3dContext,
-        winrt::com_ptr<ID2D1Device> const& d2dDevice,
-        winrt::com_ptr<IWICImagingFactory2> const& wicFactory,
-        winrt::Windows::Storage::Streams::IRandomAccessStream const& stream,
-        winrt::Windows::Graphics::SizeInt32 gifSize);
-    
+        std::unique_ptr<FrameWriter> frameWriter,
+        winrt::Windows::Graphics::SizeInt32 gifSize,
+        std::shared_ptr<EncoderThreadPool> const& threadPool,
+        std::shared_ptr<PixelBufferPool> const& bufferPool);
+    ~GifEncoder();
+
     bool ProcessFrame(winrt::Windows::Graphics::Capture::Direct3D11CaptureFrame const& frame);
+    bool ProcessFrame(
+        winrt::com_ptr<ID3D11Texture2D> const& frameTexture,
+        winrt::Windows::Graphics::SizeInt32 contentSize,
+        winrt::Windows::Foundation::TimeSpan systemRelativeTime);
 
+    // Applies to the frames that follow, until it's set again
+    void SetOverlay(std::optional<OverlayPlacement> const& overlay);
+    // Like SetOverlay, but repeats the last frame if the overlay moved and
+    // the capture session has gone quiet. Safe to call while frames are
+    // arriving on another thread.
+    bool ProcessOverlay(
+        std::optional<OverlayPlacement> const& overlay,
+        winrt::Windows::Foundation::TimeSpan systemRelativeTime);
     void StopEncoding();
+    EncoderStats Stats() { return m_stats; }
 
 private:
     struct GifFrameImage
     {
-        winrt::com_ptr<ID3D11Texture2D> Texture;
+        std::shared_ptr<PixelBuffer> Pixels;
         DiffRect Rect = {};
         winrt::Windows::Foundation::TimeSpan TimeStamp = {};
 
-        GifFrameImage(winrt::com_ptr<ID3D11Texture2D> const& texture, DiffRect const& rect, winrt::Windows::Foundation::TimeSpan const& timeStamp)
+        GifFrameImage(std::shared_ptr<PixelBuffer> const& pixels, DiffRect const& rect, winrt::Windows::Foundation::TimeSpan const& timeStamp)
         {
-            Texture = texture;
+            Pixels = pixels;
             Rect = rect;
             TimeStamp = timeStamp;
         }
     };
 
-    bool ProcessFrame(ComposedFrame const& composedFrame, bool force);
+    struct PendingFrame
+    {
+        uint64_t Sequence = 0;
+        winrt::Windows::Foundation::TimeSpan SystemRelativeTime = {};
+        std::optional<OverlayPlacement> Overlay;
+        bool Force = false;
+    };
+
+    struct PendingRead
+    {
+        uint64_t Sequence = 0;
+        DiffRect Rect = {};
+        std::vector<DiffRect> Parts;
+        std::optional<OverlayPlacement> Overlay;
+        winrt::Windows::Foundation::TimeSpan SystemRelativeTime = {};
+        // Time since the last frame we read
+        winrt::Windows::Foundation::TimeSpan TimeStampDelta = {};
+        bool Force = false;
+        // The parts, once they've been read back
+        std::shared_ptr<PixelBuffer> Pixels;
+    };
+
+    bool ShouldThrottle(winrt::Windows::Foundation::TimeSpan timeStamp, winrt::Windows::Foundation::TimeSpan lastTimeStamp);
+    void YieldDevice();
+    void SubmitFrame(ComposedFrame const& composedFrame, bool force);
+    void ProcessDiffReadback(DiffReadbackRing::Readback const& readback);
+    void ProcessRegionReadback(RegionReadbackRing::Readback const& readback);
+    // Does the CPU side of the frames that have been read back. Call it
+    // without holding the device lock.
+    void EncodeReadFrames();
+    std::shared_ptr<PixelBuffer> ReadPixels(
+        winrt::com_ptr<ID3D11Texture2D> const& stagingTexture,
+        DiffRect const& rect,
+        std::vector<DiffRect> const& parts);
+    void FinishPixels(PendingRead const& readFrame);
+    uint64_t ReuseUnchangedPixels(PixelBuffer& pixels, DiffRect const& rect);
     void EncodeFrame(std::shared_ptr<GifFrameImage> const& frame, winrt::Windows::Foundation::TimeSpan const& currentTime);
 
 private:
     winrt::com_ptr<ID3D11Device> m_d3dDevice;
-    winrt::com_ptr<ID2D1DeviceContext> m_d2dContext;
-    winrt::com_ptr<IWICBitmapEncoder> m_encoder;
-    winrt::com_ptr<IWICImageEncoder> m_imageEncoder;
+    winrt::com_ptr<ID3D11DeviceContext> m_d3dContext;
+    winrt::com_ptr<ID3D11Multithread> m_d3dMultithread;
+    std::mutex m_lock;
+    std::unique_ptr<FrameWriter> m_frameWriter;
     std::unique_ptr<FrameCompositor> m_frameCompositor;
     std::unique_ptr<TextureDiffer> m_textureDiffer;
+    std::unique_ptr<RegionReadbackRing> m_regionReadbacks;
+    // Frames waiting on their diff, oldest first
+    std::deque<PendingFrame> m_pendingFrames;
+    // Frames waiting on their changed parts, oldest first
+    std::deque<PendingRead> m_pendingReads;
+    // Frames that have been read back but not encoded yet
+    std::vector<PendingRead> m_readFrames;
+    // The overlay as of the last frame we submitted, and the last we encoded
+    std::optional<OverlayPlacement> m_submittedOverlay;
+    std::optional<OverlayPlacement> m_lastOverlay;
+    std::shared_ptr<EncoderQueue> m_encodeQueue;
+    std::shared_ptr<PixelBufferPool> m_bufferPool;
+    PixelBuffer m_canvas;
+    bool m_canvasValid = false;
+    EncoderStats m_stats = {};
     winrt::Windows::Graphics::SizeInt32 m_gifSize = {};
     winrt::Windows::Foundation::TimeSpan m_lastTimeStamp = {};
-    winrt::Windows::Foundation::TimeSpan m_lastCandidateTimeStamp = {};
+    winrt::Windows::Foundation::TimeSpan m_lastSubmittedTimeStamp = {};
+    // The last frame from the capture session, and the last one we used
+    winrt::Windows::Foundation::TimeSpan m_lastCaptureTimeStamp = {};
+    winrt::Windows::Foundation::TimeSpan m_lastCaptureSubmittedTimeStamp = {};
     uint64_t frameCount = 0;
     std::shared_ptr<GifFrameImage> m_previousFrame;
-};
\ No newline at end of file
+};
@@ -0,0 +1,194 @@
+#include "pch.h"
+#include "GifFrameWriter.h"
+
+namespace winrt
+{
+    using namespace Windows::Storage::Streams;
+}
+
+namespace util
+{
+    using namespace robmikh::common::uwp;
+}
+
+GifFrameWriter::GifFrameWriter(
+    winrt::com_ptr<IWICImagingFactory2> const& wicFactory,
+    winrt::IRandomAccessStream const& stream)
+{
+    m_wicFactory = wicFactory;
+    auto abiStream = util::CreateStreamFromRandomAccessStream(stream);
+
+    // Setup WIC to encode a gif
+    winrt::check_hresult(wicFactory->CreateEncoder(GUID_ContainerFormatGif, nullptr, m_encoder.put()));
+    winrt::check_hresult(m_encoder->Initialize(abiStream.get(), WICBitmapEncoderNoCache));
+
+    // Write the application block
+    // http://www.vurdalakov.net/misc/gif/netscape-looping-application-extension
+    winrt::com_ptr<IWICMetadataQueryWriter> metadata;
+    winrt::check_hresult(m_encoder->GetMetadataQueryWriter(metadata.put()));
+    {
+        PROPVARIANT value = {};
+        value.vt = VT_UI1 | VT_VECTOR;
+        value.caub.cElems = 11;
+        std::string text("NETSCAPE2.0");
+        std::vector<uint8_t> chars(text.begin(), text.end());
+        WINRT_VERIFY(chars.size() == 11);
+        value.caub.pElems = chars.data();
+        winrt::check_hresult(metadata->SetMetadataByName(L"/appext/application", &value));
+    }
+    {
+        PROPVARIANT value = {};
+        value.vt = VT_UI1 | VT_VECTOR;
+        value.caub.cElems = 5;
+        // The first value is the size of the block, which is the fixed value 3.
+        // The second value is the looping extension, which is the fixed value 1.
+        // The third and fourth values comprise an unsigned 2-byte integer (little endian).
+        //     The value of 0 means to loop infinitely.
+        // The final value is the block terminator, which is the fixed value 0.
+        std::vector<uint8_t> data({ 3, 1, 0, 0, 0 });
+        value.caub.pElems = data.data();
+        winrt::check_hresult(metadata->SetMetadataByName(L"/appext/data", &value));
+    }
+}
+
+void GifFrameWriter::WriteFrame(std::shared_ptr<PixelBuffer> const& framePixels, DiffRect const& rect, std::chrono::milliseconds delay)
+{
+    auto& pixels = *framePixels;
+
+    // Use 10ms units
+    auto frameDelay = delay.count() / 10;
+
+    // Wrap our pixels in a WIC bitmap
+    winrt::com_ptr<IWICBitmap> wicBitmap;
+    winrt::check_hresult(m_wicFactory->CreateBitmapFromMemory(
+        pixels.Width,
+        pixels.Height,
+        GUID_WICPixelFormat32bppBGRA,
+        pixels.Stride,
+        static_cast<uint32_t>(pixels.Data.size()),
+        pixels.Data.data(),
+        wicBitmap.put()));
+
+    // Pixels that haven't changed since the last frame can be left
+    // transparent, which lets the previous frame show through. Only the
+    // rest need colors in the palette, so they're gathered into their own
+    // bitmap. A rect spanning two cursor positions is mostly transparent,
+    // and this keeps the palette work down to the pixels that changed.
+    std::vector<uint32_t> changedPixels;
+    for (auto y = 0u; y < pixels.Height; y++)
+    {
+        auto row = reinterpret_cast<uint32_t const*>(pixels.Data.data() + static_cast<size_t>(y) * pixels.Stride);
+        for (auto x = 0u; x < pixels.Width; x++)
+        {
+            if ((row[x] >> 24) != 0)
+            {
+                changedPixels.push_back(row[x]);
+            }
+        }
+    }
+    auto hasTransparency = changedPixels.size() < static_cast<size_t>(pixels.Width) * pixels.Height;
+    auto paletteSource = wicBitmap;
+    if (hasTransparency && !changedPixels.empty())
+    {
+        // Pad out the last row with a color we already have
+        auto paletteWidth = pixels.Width;
+        auto paletteHeight = static_cast<uint32_t>((changedPixels.size() + paletteWidth - 1) / paletteWidth);
+        changedPixels.resize(static_cast<size_t>(paletteWidth) * paletteHeight, changedPixels[0]);
+        paletteSource = nullptr;
+        winrt::check_hresult(m_wicFactory->CreateBitmapFromMemory(
+            paletteWidth,
+            paletteHeight,
+            GUID_WICPixelFormat32bppBGRA,
+            paletteWidth * 4,
+            static_cast<uint32_t>(changedPixels.size() * 4),
+            reinterpret_cast<BYTE*>(changedPixels.data()),
+            paletteSource.put()));
+    }
+
+    // Build a palette for the frame
+    winrt::com_ptr<IWICPalette> palette;
+    winrt::check_hresult(m_wicFactory->CreatePalette(palette.put()));
+    winrt::check_hresult(palette->InitializeFromBitmap(paletteSource.get(), 256, hasTransparency));
+
+    // Find the color WIC reserved for transparency
+    std::optional<uint8_t> transparentIndex;
+    if (hasTransparency)
+    {
+        UINT colorCount = 0;
+        winrt::check_hresult(palette->GetColorCount(&colorCount));
+        std::vector<WICColor> colors(colorCount);
+        winrt::check_hresult(palette->GetColors(colorCount, colors.data(), &colorCount));
+        auto it = std::find_if(colors.begin(), colors.end(), [](auto color) { return (color >> 24) == 0; });
+        if (it != colors.end())
+        {
+            transparentIndex = static_cast<uint8_t>(it - colors.begin());
+        }
+    }
+
+    // Map our pixels onto the palette, anything below half alpha becomes transparent
+    winrt::com_ptr<IWICFormatConverter> converter;
+    winrt::check_hresult(m_wicFactory->CreateFormatConverter(converter.put()));
+    winrt::check_hresult(converter->Initialize(
+        wicBitmap.get(),
+        GUID_WICPixelFormat8bppIndexed,
+        WICBitmapDitherTypeNone,
+        palette.get(),
+        50.0,
+        WICBitmapPaletteTypeCustom));
+
+    // Setup our WIC frame
+    winrt::com_ptr<IWICBitmapFrameEncode> wicFrame;
+    winrt::check_hresult(m_encoder->CreateNewFrame(wicFrame.put(), nullptr));
+    winrt::check_hresult(wicFrame->Initialize(nullptr));
+    winrt::check_hresult(wicFrame->SetSize(pixels.Width, pixels.Height));
+    auto wicPixelFormat = GUID_WICPixelFormat8bppIndexed;
+    winrt::check_hresult(wicFrame->SetPixelFormat(&wicPixelFormat));
+    winrt::check_hresult(wicFrame->SetPalette(palette.get()));
+
+    // Write frame metadata
+    winrt::com_ptr<IWICMetadataQueryWriter> metadata;
+    winrt::check_hresult(wicFrame->GetMetadataQueryWriter(metadata.put()));
+    // Delay
+    {
+        PROPVARIANT delayValue = {};
+        delayValue.vt = VT_UI2;
+        delayValue.uiVal = static_cast<unsigned short>(frameDelay);
+        winrt::check_hresult(metadata->SetMetadataByName(L"/grctlext/Delay", &delayValue));
+    }
+    // Transparency
+    if (transparentIndex.has_value())
+    {
+        PROPVARIANT flagValue = {};
+        flagValue.vt = VT_BOOL;
+        flagValue.boolVal = VARIANT_TRUE;
+        winrt::check_hresult(metadata->SetMetadataByName(L"/grctlext/TransparencyFlag", &flagValue));
+
+        PROPVARIANT indexValue = {};
+        indexValue.vt = VT_UI1;
+        indexValue.bVal = transparentIndex.value();
+        winrt::check_hresult(metadata->SetMetadataByName(L"/grctlext/TransparentColorIndex", &indexValue));
+    }
+    // Left
+    {
+        PROPVARIANT metadataValue = {};
+        metadataValue.vt = VT_UI2;
+        metadataValue.uiVal = static_cast<unsigned short>(rect.Left);
+        winrt::check_hresult(metadata->SetMetadataByName(L"/imgdesc/Left", &metadataValue));
+    }
+    // Top
+    {
+        PROPVARIANT metadataValue = {};
+        metadataValue.vt = VT_UI2;
+        metadataValue.uiVal = static_cast<unsigned short>(rect.Top);
+        winrt::check_hresult(metadata->SetMetadataByName(L"/imgdesc/Top", &metadataValue));
+    }
+
+    // Write the frame to our image (this must come after you write the metadata)
+    winrt::check_hresult(wicFrame->WriteSource(converter.get(), nullptr));
+    winrt::check_hresult(wicFrame->Commit());
+}
+
+void GifFrameWriter::Commit()
+{
+    winrt::check_hresult(m_encoder->Commit());
+}
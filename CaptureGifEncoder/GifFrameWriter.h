@@ -0,0 +1,17 @@
+#pragma once
+#include "FrameWriter.h"
+
+class GifFrameWriter : public FrameWriter
+{
+public:
+    GifFrameWriter(
+        winrt::com_ptr<IWICImagingFactory2> const& wicFactory,
+        winrt::Windows::Storage::Streams::IRandomAccessStream const& stream);
+
+    void WriteFrame(std::shared_ptr<PixelBuffer> const& pixels, DiffRect const& rect, std::chrono::milliseconds delay) override;
+    void Commit() override;
+
+private:
+    winrt::com_ptr<IWICImagingFactory2> m_wicFactory;
+    winrt::com_ptr<IWICBitmapEncoder> m_encoder;
+};
@@ -0,0 +1,102 @@
+// Doesn't use the precompiled header, so that it builds without Windows
+// headers for the tests
+#include "OverlayBlend.h"
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define OVERLAY_BLEND_SSE2 1
+#endif
+
+bool operator==(OverlayPlacement const& left, OverlayPlacement const& right)
+{
+    return left.Image == right.Image && left.Left == right.Left && left.Top == right.Top;
+}
+
+bool operator!=(OverlayPlacement const& left, OverlayPlacement const& right)
+{
+    return !(left == right);
+}
+
+std::optional<DiffRect> GetOverlayRect(OverlayPlacement const& overlay, uint32_t frameWidth, uint32_t frameHeight)
+{
+    auto left = std::clamp<int64_t>(overlay.Left, 0, frameWidth);
+    auto top = std::clamp<int64_t>(overlay.Top, 0, frameHeight);
+    auto right = std::clamp<int64_t>(static_cast<int64_t>(overlay.Left) + overlay.Image->Width, 0, frameWidth);
+    auto bottom = std::clamp<int64_t>(static_cast<int64_t>(overlay.Top) + overlay.Image->Height, 0, frameHeight);
+    if (right <= left || bottom <= top)
+    {
+        return std::nullopt;
+    }
+    return DiffRect{ static_cast<uint32_t>(left), static_cast<uint32_t>(top), static_cast<uint32_t>(right), static_cast<uint32_t>(bottom) };
+}
+
+// Divides by 255 with rounding, exact for anything up to 255 * 255
+uint32_t DivideBy255(uint32_t value)
+{
+    value += 128;
+    return (value + (value >> 8)) >> 8;
+}
+
+#ifdef OVERLAY_BLEND_SSE2
+// Blends two pixels that have been widened to 16-bit lanes
+__m128i BlendPixelPair(__m128i destination, __m128i source)
+{
+    // Spread each pixel's alpha across its lanes
+    auto alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(source, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    auto inverseAlpha = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+    auto scaled = _mm_add_epi16(_mm_mullo_epi16(destination, inverseAlpha), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(scaled, _mm_srli_epi16(scaled, 8)), 8);
+}
+#endif
+
+void BlendPremultipliedRow(uint32_t* destination, uint32_t const* source, uint32_t count)
+{
+    auto i = 0u;
+#ifdef OVERLAY_BLEND_SSE2
+    auto zero = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4)
+    {
+        auto sourcePixels = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + i));
+        auto destinationPixels = _mm_loadu_si128(reinterpret_cast<__m128i const*>(destination + i));
+        auto low = BlendPixelPair(_mm_unpacklo_epi8(destinationPixels, zero), _mm_unpacklo_epi8(sourcePixels, zero));
+        auto high = BlendPixelPair(_mm_unpackhi_epi8(destinationPixels, zero), _mm_unpackhi_epi8(sourcePixels, zero));
+        auto blended = _mm_adds_epu8(_mm_packus_epi16(low, high), sourcePixels);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), blended);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        auto sourcePixel = source[i];
+        auto destinationPixel = destination[i];
+        auto inverseAlpha = 255 - (sourcePixel >> 24);
+        uint32_t result = 0;
+        for (auto shift = 0u; shift < 32; shift += 8)
+        {
+            auto channel = DivideBy255(((destinationPixel >> shift) & 0xFF) * inverseAlpha) + ((sourcePixel >> shift) & 0xFF);
+            result |= std::min(channel, 255u) << shift;
+        }
+        destination[i] = result;
+    }
+}
+
+void BlendOverlay(PixelBuffer& pixels, DiffRect const& pixelsRect, DiffRect const& clip, OverlayPlacement const& overlay)
+{
+    auto const& image = *overlay.Image;
+    auto left = std::max<int64_t>({ overlay.Left, pixelsRect.Left, clip.Left });
+    auto top = std::max<int64_t>({ overlay.Top, pixelsRect.Top, clip.Top });
+    auto right = std::min<int64_t>({ static_cast<int64_t>(overlay.Left) + image.Width, pixelsRect.Right, clip.Right });
+    auto bottom = std::min<int64_t>({ static_cast<int64_t>(overlay.Top) + image.Height, pixelsRect.Bottom, clip.Bottom });
+    if (right <= left || bottom <= top)
+    {
+        return;
+    }
+
+    auto count = static_cast<uint32_t>(right - left);
+    for (auto y = top; y < bottom; y++)
+    {
+        auto destination = reinterpret_cast<uint32_t*>(pixels.Data.data() + static_cast<size_t>(y - pixelsRect.Top) * pixels.Stride) + (left - pixelsRect.Left);
+        auto source = reinterpret_cast<uint32_t const*>(image.Data.data() + static_cast<size_t>(y - overlay.Top) * image.Stride) + (left - overlay.Left);
+        BlendPremultipliedRow(destination, source, count);
+    }
+}
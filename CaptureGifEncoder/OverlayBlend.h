@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include "DiffRect.h"
+#include "PixelBuffer.h"
+
+// An image drawn over the captured content, like the mouse cursor. The
+// image is premultiplied BGRA and is shared between frames, so a new
+// image means a new buffer.
+struct OverlayPlacement
+{
+    std::shared_ptr<PixelBuffer const> Image;
+    // Where the top left corner of the image goes, in frame coordinates
+    int32_t Left = 0;
+    int32_t Top = 0;
+};
+
+bool operator==(OverlayPlacement const& left, OverlayPlacement const& right);
+bool operator!=(OverlayPlacement const& left, OverlayPlacement const& right);
+
+// The part of the frame the overlay covers, if any of it is on screen
+std::optional<DiffRect> GetOverlayRect(OverlayPlacement const& overlay, uint32_t frameWidth, uint32_t frameHeight);
+
+// Draws premultiplied source pixels over opaque destination pixels
+void BlendPremultipliedRow(uint32_t* destination, uint32_t const* source, uint32_t count);
+
+// Draws the overlay over the part of pixels that falls within clip.
+// The pixels cover pixelsRect of the frame.
+void BlendOverlay(PixelBuffer& pixels, DiffRect const& pixelsRect, DiffRect const& clip, OverlayPlacement const& overlay);
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Tightly packed 32bpp BGRA pixels
+struct PixelBuffer
+{
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    uint32_t Stride = 0;
+    std::vector<uint8_t> Data;
+};
@@ -0,0 +1,60 @@
+#include "pch.h"
+#include "PixelBufferPool.h"
+
+PixelBufferPool::PixelBufferPool(size_t maxFreeBuffers)
+{
+    m_maxFreeBuffers = maxFreeBuffers;
+}
+
+std::shared_ptr<PixelBuffer> PixelBufferPool::Acquire(uint32_t width, uint32_t height)
+{
+    auto stride = width * 4;
+    auto size = static_cast<size_t>(stride) * height;
+
+    std::unique_ptr<PixelBuffer> buffer;
+    {
+        std::lock_guard lock(m_lock);
+        // Prefer a buffer that won't need to grow
+        auto it = std::find_if(m_freeBuffers.begin(), m_freeBuffers.end(), [size](auto const& candidate)
+        {
+            return candidate->Data.capacity() >= size;
+        });
+        if (it == m_freeBuffers.end() && !m_freeBuffers.empty())
+        {
+            it = m_freeBuffers.end() - 1;
+        }
+        if (it != m_freeBuffers.end())
+        {
+            buffer = std::move(*it);
+            m_freeBuffers.erase(it);
+        }
+    }
+    if (buffer == nullptr)
+    {
+        buffer = std::make_unique<PixelBuffer>();
+    }
+
+    buffer->Width = width;
+    buffer->Height = height;
+    buffer->Stride = stride;
+    buffer->Data.resize(size);
+
+    std::weak_ptr<PixelBufferPool> weakPool = weak_from_this();
+    return std::shared_ptr<PixelBuffer>(buffer.release(), [weakPool](PixelBuffer* released)
+    {
+        std::unique_ptr<PixelBuffer> owned(released);
+        if (auto pool = weakPool.lock())
+        {
+            pool->Release(std::move(owned));
+        }
+    });
+}
+
+void PixelBufferPool::Release(std::unique_ptr<PixelBuffer> buffer)
+{
+    std::lock_guard lock(m_lock);
+    if (m_freeBuffers.size() < m_maxFreeBuffers)
+    {
+        m_freeBuffers.push_back(std::move(buffer));
+    }
+}
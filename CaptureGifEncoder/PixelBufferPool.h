@@ -0,0 +1,20 @@
+#pragma once
+#include "PixelBuffer.h"
+
+// Recycles frame buffers between encoders. Buffers acquired from the pool
+// go back to it once the last reference is released.
+class PixelBufferPool : public std::enable_shared_from_this<PixelBufferPool>
+{
+public:
+    PixelBufferPool(size_t maxFreeBuffers = 32);
+
+    std::shared_ptr<PixelBuffer> Acquire(uint32_t width, uint32_t height);
+
+private:
+    void Release(std::unique_ptr<PixelBuffer> buffer);
+
+private:
+    std::mutex m_lock;
+    std::vector<std::unique_ptr<PixelBuffer>> m_freeBuffers;
+    size_t m_maxFreeBuffers = 0;
+};
@@ -0,0 +1,237 @@
+// Doesn't use the precompiled header, so that it builds without Windows
+// headers for the tests
+#include "PngFilter.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PNG_FILTER_SSE2 1
+#endif
+
+enum class PngFilterType : uint8_t
+{
+    None = 0,
+    Sub = 1,
+    Up = 2,
+    Average = 3,
+    Paeth = 4,
+};
+
+const uint32_t PngBytesPerPixel = 4;
+// Rows are stored after some zero padding so that the left neighbor of
+// the first pixel reads as zero, which is what the filters expect.
+const uint32_t PngRowPadding = 16;
+
+uint8_t PaethPredictor(uint8_t a, uint8_t b, uint8_t c)
+{
+    auto pa = std::abs(static_cast<int32_t>(b) - c);
+    auto pb = std::abs(static_cast<int32_t>(a) - c);
+    auto pc = std::abs(static_cast<int32_t>(a) + b - 2 * c);
+    if (pa <= pb && pa <= pc)
+    {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+#ifdef PNG_FILTER_SSE2
+__m128i Abs16(__m128i value)
+{
+    return _mm_max_epi16(value, _mm_sub_epi16(_mm_setzero_si128(), value));
+}
+
+// Same as PaethPredictor, on 16-bit lanes
+__m128i PaethPredictor16(__m128i a, __m128i b, __m128i c)
+{
+    auto bc = _mm_sub_epi16(b, c);
+    auto ac = _mm_sub_epi16(a, c);
+    auto pa = Abs16(bc);
+    auto pb = Abs16(ac);
+    auto pc = Abs16(_mm_add_epi16(bc, ac));
+    auto notA = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+    auto notB = _mm_cmpgt_epi16(pb, pc);
+    auto bOrC = _mm_or_si128(_mm_and_si128(notB, c), _mm_andnot_si128(notB, b));
+    return _mm_or_si128(_mm_andnot_si128(notA, a), _mm_and_si128(notA, bOrC));
+}
+
+__m128i Load(uint8_t const* data)
+{
+    return _mm_loadu_si128(reinterpret_cast<__m128i const*>(data));
+}
+
+void Store(uint8_t* data, __m128i value)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(data), value);
+}
+#endif
+
+void FilterSub(uint8_t const* row, uint8_t* output, size_t length)
+{
+    size_t i = 0;
+#ifdef PNG_FILTER_SSE2
+    for (; i + 16 <= length; i += 16)
+    {
+        Store(output + i, _mm_sub_epi8(Load(row + i), Load(row + i - PngBytesPerPixel)));
+    }
+#endif
+    for (; i < length; i++)
+    {
+        output[i] = row[i] - row[i - PngBytesPerPixel];
+    }
+}
+
+void FilterUp(uint8_t const* row, uint8_t const* previousRow, uint8_t* output, size_t length)
+{
+    size_t i = 0;
+#ifdef PNG_FILTER_SSE2
+    for (; i + 16 <= length; i += 16)
+    {
+        Store(output + i, _mm_sub_epi8(Load(row + i), Load(previousRow + i)));
+    }
+#endif
+    for (; i < length; i++)
+    {
+        output[i] = row[i] - previousRow[i];
+    }
+}
+
+void FilterAverage(uint8_t const* row, uint8_t const* previousRow, uint8_t* output, size_t length)
+{
+    size_t i = 0;
+#ifdef PNG_FILTER_SSE2
+    auto one = _mm_set1_epi8(1);
+    for (; i + 16 <= length; i += 16)
+    {
+        auto a = Load(row + i - PngBytesPerPixel);
+        auto b = Load(previousRow + i);
+        // _mm_avg_epu8 rounds up, PNG rounds down
+        auto average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+        Store(output + i, _mm_sub_epi8(Load(row + i), average));
+    }
+#endif
+    for (; i < length; i++)
+    {
+        auto average = (static_cast<uint32_t>(row[i - PngBytesPerPixel]) + previousRow[i]) / 2;
+        output[i] = static_cast<uint8_t>(row[i] - average);
+    }
+}
+
+void FilterPaeth(uint8_t const* row, uint8_t const* previousRow, uint8_t* output, size_t length)
+{
+    size_t i = 0;
+#ifdef PNG_FILTER_SSE2
+    auto zero = _mm_setzero_si128();
+    for (; i + 16 <= length; i += 16)
+    {
+        auto a = Load(row + i - PngBytesPerPixel);
+        auto b = Load(previousRow + i);
+        auto c = Load(previousRow + i - PngBytesPerPixel);
+        auto low = PaethPredictor16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+        auto high = PaethPredictor16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+        Store(output + i, _mm_sub_epi8(Load(row + i), _mm_packus_epi16(low, high)));
+    }
+#endif
+    for (; i < length; i++)
+    {
+        auto predicted = PaethPredictor(row[i - PngBytesPerPixel], previousRow[i], previousRow[i - PngBytesPerPixel]);
+        output[i] = row[i] - predicted;
+    }
+}
+
+// Sum of the filtered bytes as signed magnitudes
+uint64_t FilterScore(uint8_t const* filtered, size_t length)
+{
+    uint64_t score = 0;
+    size_t i = 0;
+#ifdef PNG_FILTER_SSE2
+    auto zero = _mm_setzero_si128();
+    auto sums = _mm_setzero_si128();
+    for (; i + 16 <= length; i += 16)
+    {
+        auto value = Load(filtered + i);
+        auto magnitude = _mm_min_epu8(value, _mm_sub_epi8(zero, value));
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(magnitude, zero));
+    }
+    score += static_cast<uint64_t>(_mm_cvtsi128_si32(sums));
+    score += static_cast<uint64_t>(_mm_cvtsi128_si32(_mm_srli_si128(sums, 8)));
+#endif
+    for (; i < length; i++)
+    {
+        score += std::min<uint32_t>(filtered[i], 256 - filtered[i]);
+    }
+    return score;
+}
+
+// Transparent pixels only mean "unchanged", so their color is dropped to
+// give the filters and deflate runs of zeros
+void ConvertBgraRowToRgba(uint8_t const* source, uint8_t* destination, uint32_t width)
+{
+    for (auto x = 0u; x < width; x++)
+    {
+        auto visible = source[3] != 0;
+        destination[0] = visible ? source[2] : 0;
+        destination[1] = visible ? source[1] : 0;
+        destination[2] = visible ? source[0] : 0;
+        destination[3] = source[3];
+        source += 4;
+        destination += PngBytesPerPixel;
+    }
+}
+
+void FilterPngRows(PixelBuffer const& pixels, uint32_t firstRow, uint32_t rowCount, std::vector<uint8_t>& output)
+{
+    auto length = static_cast<size_t>(pixels.Width) * PngBytesPerPixel;
+
+    std::vector<uint8_t> previousStorage(PngRowPadding + length, 0);
+    std::vector<uint8_t> currentStorage(PngRowPadding + length, 0);
+    auto previousRow = previousStorage.data() + PngRowPadding;
+    auto currentRow = currentStorage.data() + PngRowPadding;
+    // The row above a band still counts, only the first row of the image
+    // is filtered against zeros.
+    if (firstRow > 0)
+    {
+        ConvertBgraRowToRgba(pixels.Data.data() + static_cast<size_t>(firstRow - 1) * pixels.Stride, previousRow, pixels.Width);
+    }
+
+    std::array<std::vector<uint8_t>, 5> candidates;
+    for (auto&& candidate : candidates)
+    {
+        candidate.resize(length);
+    }
+
+    output.resize(static_cast<size_t>(rowCount) * (length + 1));
+    auto destination = output.data();
+    for (auto y = firstRow; y < firstRow + rowCount; y++)
+    {
+        ConvertBgraRowToRgba(pixels.Data.data() + static_cast<size_t>(y) * pixels.Stride, currentRow, pixels.Width);
+
+        memcpy(candidates[static_cast<size_t>(PngFilterType::None)].data(), currentRow, length);
+        FilterSub(currentRow, candidates[static_cast<size_t>(PngFilterType::Sub)].data(), length);
+        FilterUp(currentRow, previousRow, candidates[static_cast<size_t>(PngFilterType::Up)].data(), length);
+        FilterAverage(currentRow, previousRow, candidates[static_cast<size_t>(PngFilterType::Average)].data(), length);
+        FilterPaeth(currentRow, previousRow, candidates[static_cast<size_t>(PngFilterType::Paeth)].data(), length);
+
+        size_t bestFilter = 0;
+        auto bestScore = std::numeric_limits<uint64_t>::max();
+        for (auto i = 0u; i < candidates.size(); i++)
+        {
+            auto score = FilterScore(candidates[i].data(), length);
+            if (score < bestScore)
+            {
+                bestScore = score;
+                bestFilter = i;
+            }
+        }
+
+        *destination++ = static_cast<uint8_t>(bestFilter);
+        memcpy(destination, candidates[bestFilter].data(), length);
+        destination += length;
+
+        std::swap(previousRow, currentRow);
+    }
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "PixelBuffer.h"
+
+// Converts rows of BGRA pixels to RGBA and filters them for PNG. Pixels
+// with zero alpha are written as all zeros, whatever their color. Each
+// row uses whichever filter gives the smallest sum of absolute
+// differences, and is prefixed with its filter type byte. Rows can be
+// filtered independently, so a frame can be split into bands.
+void FilterPngRows(PixelBuffer const& pixels, uint32_t firstRow, uint32_t rowCount, std::vector<uint8_t>& output);
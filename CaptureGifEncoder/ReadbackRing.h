@@ -0,0 +1,107 @@
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <thread>
+#include <utility>
+
+// Keeps several GPU readbacks in flight so that the CPU never has to wait
+// on work it just submitted. Slots are handed out round robin and results
+// come back in submission order. Nothing here knows about D3D, the device
+// only needs to provide:
+//
+//   using Result = ...;
+//   void Submit(uint32_t slot, Args...);          // Queue the copy for a slot
+//   bool TryRead(uint32_t slot, Result& result);  // Must not block
+//
+// A result may reference resources owned by its slot, so it is only good
+// until the next call to Submit.
+template <typename Device>
+class ReadbackRing
+{
+public:
+    using Result = typename Device::Result;
+
+    struct Readback
+    {
+        // Counts up from zero with each call to Submit
+        uint64_t Sequence = 0;
+        Result Value = {};
+    };
+
+    ReadbackRing(Device device, uint32_t slotCount) : m_device(std::move(device))
+    {
+        assert(slotCount > 0);
+        m_slotCount = slotCount;
+    }
+
+    Device& GetDevice() { return m_device; }
+    uint32_t SlotCount() { return m_slotCount; }
+    size_t InFlight() { return m_inFlight.size(); }
+    bool IsEmpty() { return m_inFlight.empty(); }
+    bool IsFull() { return m_inFlight.size() == m_slotCount; }
+
+    // The caller has to make room first, see Poll and Wait
+    template <typename... Args>
+    uint64_t Submit(Args&&... args)
+    {
+        assert(!IsFull());
+        auto sequence = m_nextSequence++;
+        m_device.Submit(SlotOf(sequence), std::forward<Args>(args)...);
+        m_inFlight.push_back(sequence);
+        return sequence;
+    }
+
+    // Returns the oldest readback if it has landed
+    std::optional<Readback> Poll()
+    {
+        if (m_inFlight.empty())
+        {
+            return std::nullopt;
+        }
+
+        Readback readback = {};
+        readback.Sequence = m_inFlight.front();
+        if (!m_device.TryRead(SlotOf(readback.Sequence), readback.Value))
+        {
+            return std::nullopt;
+        }
+        m_inFlight.pop_front();
+        return std::optional(std::move(readback));
+    }
+
+    // Returns the oldest readback, waiting for it if we have to. Idle is
+    // called between polls, which lets the caller give up any locks the
+    // GPU doesn't need while it waits.
+    template <typename Idle>
+    std::optional<Readback> Wait(Idle&& idle)
+    {
+        while (!m_inFlight.empty())
+        {
+            if (auto readback = Poll())
+            {
+                return readback;
+            }
+            idle();
+        }
+        return std::nullopt;
+    }
+
+    std::optional<Readback> Wait()
+    {
+        return Wait([]() { std::this_thread::yield(); });
+    }
+
+private:
+    uint32_t SlotOf(uint64_t sequence)
+    {
+        return static_cast<uint32_t>(sequence % m_slotCount);
+    }
+
+private:
+    Device m_device;
+    uint32_t m_slotCount = 0;
+    uint64_t m_nextSequence = 0;
+    std::deque<uint64_t> m_inFlight;
+};
@@ -0,0 +1,180 @@
+#include "pch.h"
+#include "SyntheticFrameSource.h"
+#include "DeviceLock.h"
+
+namespace winrt
+{
+    using namespace Windows::Graphics;
+}
+
+const uint32_t BlockSize = 64;
+const uint32_t LineHeight = 18;
+const uint32_t ScrollStep = 12;
+const uint32_t CursorSize = 16;
+
+SyntheticFrameSource::SyntheticFrameSource(
+    winrt::com_ptr<ID3D11Device> const& d3dDevice,
+    winrt::com_ptr<ID3D11DeviceContext> const& d3dContext,
+    winrt::SizeInt32 frameSize,
+    uint32_t seed)
+{
+    m_d3dContext = d3dContext;
+    m_d3dMultithread = d3dContext.as<ID3D11Multithread>();
+    m_frameSize = frameSize;
+    m_seed = seed;
+    // The encoder treats a zero timestamp as "no frames yet"
+    m_time = std::chrono::seconds(1);
+
+    D3D11_TEXTURE2D_DESC textureDesc = {};
+    textureDesc.Width = static_cast<uint32_t>(frameSize.Width);
+    textureDesc.Height = static_cast<uint32_t>(frameSize.Height);
+    textureDesc.MipLevels = 1;
+    textureDesc.ArraySize = 1;
+    textureDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+    textureDesc.SampleDesc.Count = 1;
+    textureDesc.Usage = D3D11_USAGE_DEFAULT;
+    textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    winrt::check_hresult(d3dDevice->CreateTexture2D(&textureDesc, nullptr, m_texture.put()));
+
+    // A gradient tinted differently for each source
+    auto width = static_cast<uint32_t>(frameSize.Width);
+    auto height = static_cast<uint32_t>(frameSize.Height);
+    m_background.resize(static_cast<size_t>(width) * height);
+    for (auto y = 0u; y < height; y++)
+    {
+        for (auto x = 0u; x < width; x++)
+        {
+            auto blue = static_cast<uint8_t>((x * 255) / width);
+            auto green = static_cast<uint8_t>((y * 255) / height);
+            auto red = static_cast<uint8_t>(seed * 53);
+            m_background[y * width + x] = 0xFF000000 | (red << 16) | (green << 8) | blue;
+        }
+    }
+    m_pixels = m_background;
+
+    m_scrolling = (seed % 2) == 1;
+    if (m_scrolling)
+    {
+        CreateDocument();
+    }
+    CreateCursor();
+}
+
+SyntheticFrame SyntheticFrameSource::NextFrame()
+{
+    auto width = static_cast<uint32_t>(m_frameSize.Width);
+    auto height = static_cast<uint32_t>(m_frameSize.Height);
+    auto rangeX = width > BlockSize ? width - BlockSize : 1;
+    auto rangeY = height > BlockSize ? height - BlockSize : 1;
+    auto step = static_cast<uint32_t>(m_frameCount) * 7 + m_seed * 97;
+
+    if (m_scrolling)
+    {
+        ScrollDocument();
+    }
+    else
+    {
+        m_pixels = m_background;
+        FillBlock(step % rangeX, (step / 2) % rangeY, 0xFFFFFFFF - m_seed);
+    }
+
+    {
+        DeviceLock lock(m_d3dMultithread);
+        m_d3dContext->UpdateSubresource(m_texture.get(), 0, nullptr, m_pixels.data(), width * 4, 0);
+    }
+
+    SyntheticFrame frame = {};
+    frame.Texture = m_texture;
+    frame.ContentSize = m_frameSize;
+    frame.SystemRelativeTime = m_time;
+
+    // The cursor moves on a different path than the block
+    OverlayPlacement cursor = {};
+    cursor.Image = m_cursor;
+    cursor.Left = static_cast<int32_t>((step * 3) % width);
+    cursor.Top = static_cast<int32_t>((step * 5) % height);
+    frame.Overlay = cursor;
+
+    // Just above the encoder's 30fps throttle
+    m_time += std::chrono::milliseconds(40);
+    m_frameCount++;
+    return frame;
+}
+
+void SyntheticFrameSource::FillBlock(uint32_t left, uint32_t top, uint32_t color)
+{
+    auto width = static_cast<uint32_t>(m_frameSize.Width);
+    auto height = static_cast<uint32_t>(m_frameSize.Height);
+    auto right = std::min(left + BlockSize, width);
+    auto bottom = std::min(top + BlockSize, height);
+    for (auto y = top; y < bottom; y++)
+    {
+        std::fill(m_pixels.begin() + y * width + left, m_pixels.begin() + y * width + right, color);
+    }
+}
+
+void SyntheticFrameSource::CreateDocument()
+{
+    // Lines of random "glyphs" on a white page, a few screens tall
+    auto width = static_cast<uint32_t>(m_frameSize.Width);
+    m_documentHeight = static_cast<uint32_t>(m_frameSize.Height) * 4;
+    m_document.assign(static_cast<size_t>(width) * m_documentHeight, 0xFFFFFFFF);
+
+    auto random = m_seed * 2654435761u + 1;
+    auto nextRandom = [&random]()
+    {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        return random;
+    };
+
+    for (auto lineTop = 0u; lineTop + LineHeight <= m_documentHeight; lineTop += LineHeight)
+    {
+        for (auto glyphLeft = 16u; glyphLeft + 10 <= width; glyphLeft += 12)
+        {
+            auto glyph = nextRandom();
+            for (auto y = 0u; y < 12; y++)
+            {
+                for (auto x = 0u; x < 10; x++)
+                {
+                    if ((glyph >> ((y * 10 + x) % 32)) & 1)
+                    {
+                        m_document[static_cast<size_t>(lineTop + y) * width + glyphLeft + x] = 0xFF202020;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void SyntheticFrameSource::ScrollDocument()
+{
+    auto width = static_cast<uint32_t>(m_frameSize.Width);
+    auto height = static_cast<uint32_t>(m_frameSize.Height);
+    auto range = m_documentHeight - height;
+    auto offset = static_cast<uint32_t>((m_frameCount * ScrollStep) % range);
+    std::copy(
+        m_document.begin() + static_cast<size_t>(offset) * width,
+        m_document.begin() + static_cast<size_t>(offset + height) * width,
+        m_pixels.begin());
+}
+
+void SyntheticFrameSource::CreateCursor()
+{
+    // A half transparent arrow, in premultiplied BGRA
+    auto cursor = std::make_shared<PixelBuffer>();
+    cursor->Width = CursorSize;
+    cursor->Height = CursorSize;
+    cursor->Stride = CursorSize * 4;
+    cursor->Data.resize(static_cast<size_t>(cursor->Stride) * CursorSize);
+    auto pixels = reinterpret_cast<uint32_t*>(cursor->Data.data());
+    for (auto y = 0u; y < CursorSize; y++)
+    {
+        for (auto x = 0u; x <= y; x++)
+        {
+            pixels[y * CursorSize + x] = (x == 0 || x == y) ? 0xFF000000 : 0x80808080;
+        }
+    }
+    m_cursor = cursor;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "OverlayBlend.h"
+
+struct SyntheticFrame
+{
+    winrt::com_ptr<ID3D11Texture2D> Texture;
+    winrt::Windows::Graphics::SizeInt32 ContentSize = {};
+    winrt::Windows::Foundation::TimeSpan SystemRelativeTime = {};
+    std::optional<OverlayPlacement> Overlay;
+};
+
+// Stands in for a capture session. Even sources move a block across a
+// static background, so every frame has a small change to encode. Odd
+// sources scroll through a page of text-like lines instead. Either way, a
+// cursor wanders over the top.
+class SyntheticFrameSource
+{
+public:
+    SyntheticFrameSource(
+        winrt::com_ptr<ID3D11Device> const& d3dDevice,
+        winrt::com_ptr<ID3D11DeviceContext> const& d3dContext,
+        winrt::Windows::Graphics::SizeInt32 frameSize,
+        uint32_t seed);
+
+    SyntheticFrame NextFrame();
+
+private:
+    void FillBlock(uint32_t left, uint32_t top, uint32_t color);
+    void CreateDocument();
+    void ScrollDocument();
+    void CreateCursor();
+
+private:
+    winrt::com_ptr<ID3D11DeviceContext> m_d3dContext;
+    winrt::com_ptr<ID3D11Multithread> m_d3dMultithread;
+    winrt::com_ptr<ID3D11Texture2D> m_texture;
+    winrt::Windows::Graphics::SizeInt32 m_frameSize = {};
+    std::vector<uint32_t> m_background;
+    std::vector<uint32_t> m_pixels;
+    std::vector<uint32_t> m_document;
+    uint32_t m_documentHeight = 0;
+    bool m_scrolling = false;
+    std::shared_ptr<PixelBuffer const> m_cursor;
+    uint32_t m_seed = 0;
+    uint64_t m_frameCount = 0;
+    winrt::Windows::Foundation::TimeSpan m_time = {};
+};
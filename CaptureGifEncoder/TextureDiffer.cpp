@@ -18,7 +18,7 @@ T ReadFromBuffer(
     assert(sizeof(T) <= desc.ByteWidth);
 
     D3D11_MAPPED_SUBRESOURCE mapped = {};
-    d3dContext->Map(stagingBuffer.get(), 0, D3D11_MAP_READ, 0, &mapped);
+    winrt::check_hresult(d3dContext->Map(stagingBuffer.get(), 0, D3D11_MAP_READ, 0, &mapped));
 
     T result = {};
     result = *reinterpret_cast<T*>(mapped.pData);
@@ -28,10 +28,134 @@ T ReadFromBuffer(
     return result;
 }
 
+// Enough for two frames to be in flight while we read the third
+const uint32_t DiffReadbackSlots = 3;
+
+DiffReadbackDevice::DiffReadbackDevice(
+    winrt::com_ptr<ID3D11Device> const& d3dDevice,
+    winrt::com_ptr<ID3D11DeviceContext> const& d3dContext,
+    winrt::SizeInt32 textureSize,
+    uint32_t slotCount)
+{
+    m_d3dContext = d3dContext;
+
+    D3D11_BUFFER_DESC diffStagingBufferDesc = {};
+    diffStagingBufferDesc.ByteWidth = static_cast<uint32_t>(sizeof(DiffRect));
+    diffStagingBufferDesc.Usage = D3D11_USAGE_STAGING;
+    diffStagingBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+    // Frames stay on the GPU until we know which parts of them changed
+    D3D11_TEXTURE2D_DESC frameDesc = {};
+    frameDesc.Width = static_cast<uint32_t>(textureSize.Width);
+    frameDesc.Height = static_cast<uint32_t>(textureSize.Height);
+    frameDesc.MipLevels = 1;
+    frameDesc.ArraySize = 1;
+    frameDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+    frameDesc.SampleDesc.Count = 1;
+    frameDesc.Usage = D3D11_USAGE_DEFAULT;
+
+    D3D11_QUERY_DESC queryDesc = {};
+    queryDesc.Query = D3D11_QUERY_EVENT;
+
+    m_slots.resize(slotCount);
+    for (auto&& slot : m_slots)
+    {
+        winrt::check_hresult(d3dDevice->CreateBuffer(&diffStagingBufferDesc, nullptr, slot.DiffStagingBuffer.put()));
+        winrt::check_hresult(d3dDevice->CreateTexture2D(&frameDesc, nullptr, slot.FrameTexture.put()));
+        winrt::check_hresult(d3dDevice->CreateQuery(&queryDesc, slot.Query.put()));
+    }
+}
+
+void DiffReadbackDevice::Submit(uint32_t slot, winrt::com_ptr<ID3D11Buffer> const& diffBuffer, winrt::com_ptr<ID3D11Texture2D> const& frameTexture)
+{
+    auto& resources = m_slots[slot];
+    m_d3dContext->CopyResource(resources.DiffStagingBuffer.get(), diffBuffer.get());
+    // The frame texture will be drawn over before we get our result
+    m_d3dContext->CopyResource(resources.FrameTexture.get(), frameTexture.get());
+    m_d3dContext->End(resources.Query.get());
+}
+
+bool DiffReadbackDevice::TryRead(uint32_t slot, DiffReadback& result)
+{
+    auto& resources = m_slots[slot];
+    auto hr = m_d3dContext->GetData(resources.Query.get(), nullptr, 0, 0);
+    if (hr == S_FALSE)
+    {
+        return false;
+    }
+    winrt::check_hresult(hr);
+
+    // The copies are done, so mapping won't stall
+    auto diffRect = ReadFromBuffer<DiffRect>(m_d3dContext, resources.DiffStagingBuffer);
+    result.Rect = diffRect.IsValid() ? std::optional(diffRect) : std::nullopt;
+    result.Frame = resources.FrameTexture;
+    return true;
+}
+
+RegionReadbackDevice::RegionReadbackDevice(
+    winrt::com_ptr<ID3D11Device> const& d3dDevice,
+    winrt::com_ptr<ID3D11DeviceContext> const& d3dContext,
+    winrt::SizeInt32 textureSize,
+    uint32_t slotCount)
+{
+    m_d3dContext = d3dContext;
+
+    D3D11_TEXTURE2D_DESC stagingDesc = {};
+    stagingDesc.Width = static_cast<uint32_t>(textureSize.Width);
+    stagingDesc.Height = static_cast<uint32_t>(textureSize.Height);
+    stagingDesc.MipLevels = 1;
+    stagingDesc.ArraySize = 1;
+    stagingDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+    stagingDesc.SampleDesc.Count = 1;
+    stagingDesc.Usage = D3D11_USAGE_STAGING;
+    stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+    D3D11_QUERY_DESC queryDesc = {};
+    queryDesc.Query = D3D11_QUERY_EVENT;
+
+    m_slots.resize(slotCount);
+    for (auto&& slot : m_slots)
+    {
+        winrt::check_hresult(d3dDevice->CreateTexture2D(&stagingDesc, nullptr, slot.StagingTexture.put()));
+        winrt::check_hresult(d3dDevice->CreateQuery(&queryDesc, slot.Query.put()));
+    }
+}
+
+void RegionReadbackDevice::Submit(uint32_t slot, winrt::com_ptr<ID3D11Texture2D> const& frameTexture, std::vector<DiffRect> const& regions)
+{
+    auto& resources = m_slots[slot];
+    for (auto&& region : regions)
+    {
+        D3D11_BOX box = {};
+        box.left = region.Left;
+        box.right = region.Right;
+        box.top = region.Top;
+        box.bottom = region.Bottom;
+        box.back = 1;
+        m_d3dContext->CopySubresourceRegion(resources.StagingTexture.get(), 0, region.Left, region.Top, 0, frameTexture.get(), 0, &box);
+    }
+    m_d3dContext->End(resources.Query.get());
+}
+
+bool RegionReadbackDevice::TryRead(uint32_t slot, winrt::com_ptr<ID3D11Texture2D>& result)
+{
+    auto& resources = m_slots[slot];
+    auto hr = m_d3dContext->GetData(resources.Query.get(), nullptr, 0, 0);
+    if (hr == S_FALSE)
+    {
+        return false;
+    }
+    winrt::check_hresult(hr);
+
+    result = resources.StagingTexture;
+    return true;
+}
+
 TextureDiffer::TextureDiffer(
     winrt::com_ptr<ID3D11Device> const& d3dDevice, 
     winrt::com_ptr<ID3D11DeviceContext> const& d3dContext, 
-    winrt::SizeInt32 textureSize)
+    winrt::SizeInt32 textureSize) :
+    m_readbacks(DiffReadbackDevice(d3dDevice, d3dContext, textureSize, DiffReadbackSlots), DiffReadbackSlots)
 {
     m_d3dDevice = d3dDevice;
     m_d3dContext = d3dContext;
@@ -72,11 +196,12 @@ TextureDiffer::TextureDiffer(
     initData.pSysMem = reinterpret_cast<void*>(&initialRect);
     winrt::check_hresult(d3dDevice->CreateBuffer(&diffDefaultBufferDesc, &initData, m_diffDefaultBuffer.put()));
 
-    D3D11_BUFFER_DESC diffStagingBufferDesc = {};
-    diffStagingBufferDesc.ByteWidth = diffBufferSize;
-    diffStagingBufferDesc.Usage = D3D11_USAGE_STAGING;
-    diffStagingBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-    winrt::check_hresult(d3dDevice->CreateBuffer(&diffStagingBufferDesc, nullptr, m_diffStagingBuffer.put()));
+    // The first frame has nothing to diff against, so it's read back as a whole
+    DiffRect fullFrameRect = {};
+    fullFrameRect.Right = static_cast<uint32_t>(textureSize.Width);
+    fullFrameRect.Bottom = static_cast<uint32_t>(textureSize.Height);
+    initData.pSysMem = reinterpret_cast<void*>(&fullFrameRect);
+    winrt::check_hresult(d3dDevice->CreateBuffer(&diffDefaultBufferDesc, &initData, m_fullFrameBuffer.put()));
 
     D3D11_UNORDERED_ACCESS_VIEW_DESC uavDiff = {};
     uavDiff.Format = DXGI_FORMAT_UNKNOWN;
@@ -85,40 +210,32 @@ TextureDiffer::TextureDiffer(
     winrt::check_hresult(d3dDevice->CreateUnorderedAccessView(m_diffBuffer.get(), &uavDiff, m_diffBufferUAV.put()));
 
     winrt::check_hresult(d3dDevice->CreateComputeShader(g_main, ARRAYSIZE(g_main), nullptr, m_diffShader.put()));
-
-    std::array<ID3D11UnorderedAccessView*, 1> uavs = { m_diffBufferUAV.get() };
-    d3dContext->CSSetShader(m_diffShader.get(), nullptr, 0);
-    d3dContext->CSSetUnorderedAccessViews(0, 1, uavs.data(), nullptr);
 }
 
-std::optional<DiffRect> TextureDiffer::ProcessFrame(winrt::com_ptr<ID3D11Texture2D> const& frameTexture)
+uint64_t TextureDiffer::SubmitFrame(winrt::com_ptr<ID3D11Texture2D> const& frameTexture)
 {
     if (m_firstFrame)
     {
         m_firstFrame = false;
         m_d3dContext->CopyResource(m_previousTexture.get(), frameTexture.get());
-        return std::optional<DiffRect>(DiffRect{ 0, 0, static_cast<uint32_t>(m_textureSize.Width), static_cast<uint32_t>(m_textureSize.Height) });
+        return m_readbacks.Submit(m_fullFrameBuffer, frameTexture);
     }
     
     winrt::com_ptr<ID3D11ShaderResourceView> frameTextureSRV;
     winrt::check_hresult(m_d3dDevice->CreateShaderResourceView(frameTexture.get(), nullptr, frameTextureSRV.put()));
 
     m_d3dContext->CopyResource(m_diffBuffer.get(), m_diffDefaultBuffer.get());
+    // Other differs may share our context, so bind our state every time
+    std::array<ID3D11UnorderedAccessView*, 1> uavs = { m_diffBufferUAV.get() };
+    m_d3dContext->CSSetShader(m_diffShader.get(), nullptr, 0);
+    m_d3dContext->CSSetUnorderedAccessViews(0, 1, uavs.data(), nullptr);
     std::array<ID3D11ShaderResourceView*, 2> srvs = { frameTextureSRV.get(), m_previousTextureSRV.get() };
     m_d3dContext->CSSetShaderResources(0, 2, srvs.data());
     m_d3dContext->Dispatch(static_cast<uint32_t>(m_textureSize.Width) / 2, static_cast<uint32_t>(m_textureSize.Height) / 2, 1);
+    std::array<ID3D11ShaderResourceView*, 2> nullSrvs = {};
+    m_d3dContext->CSSetShaderResources(0, 2, nullSrvs.data());
 
-    m_d3dContext->CopyResource(m_diffStagingBuffer.get(), m_diffBuffer.get());
+    auto sequence = m_readbacks.Submit(m_diffBuffer, frameTexture);
     m_d3dContext->CopyResource(m_previousTexture.get(), frameTexture.get());
-
-    auto diffRect = ReadFromBuffer<DiffRect>(m_d3dContext, m_diffStagingBuffer);
-
-    if (diffRect.IsValid())
-    {
-        return std::optional(diffRect);
-    }
-    else
-    {
-        return std::nullopt;
-    }
+    return sequence;
 }
@@ -1,28 +1,79 @@
 #pragma once
+#include "DiffRect.h"
+#include "ReadbackRing.h"
 
-struct DiffRect
+struct DiffReadback
 {
-    uint32_t Left;
-    uint32_t Top;
-    uint32_t Right;
-    uint32_t Bottom;
+    std::optional<DiffRect> Rect;
+    // A GPU copy of the frame that was diffed, so that the parts that
+    // changed can be read back later. Like any ring result, it is only
+    // good until the next frame is submitted.
+    winrt::com_ptr<ID3D11Texture2D> Frame;
+};
 
-    uint32_t Width()
-    {
-        return Right - Left;
-    }
+// Copies diff results into staging buffers and frames into GPU textures,
+// using an event query per slot to find out when they can be read without
+// stalling.
+class DiffReadbackDevice
+{
+public:
+    using Result = DiffReadback;
+
+    DiffReadbackDevice(
+        winrt::com_ptr<ID3D11Device> const& d3dDevice,
+        winrt::com_ptr<ID3D11DeviceContext> const& d3dContext,
+        winrt::Windows::Graphics::SizeInt32 textureSize,
+        uint32_t slotCount);
+
+    void Submit(uint32_t slot, winrt::com_ptr<ID3D11Buffer> const& diffBuffer, winrt::com_ptr<ID3D11Texture2D> const& frameTexture);
+    bool TryRead(uint32_t slot, DiffReadback& result);
 
-    uint32_t Height()
+private:
+    struct Slot
     {
-        return Bottom - Top;
-    }
+        winrt::com_ptr<ID3D11Buffer> DiffStagingBuffer;
+        winrt::com_ptr<ID3D11Texture2D> FrameTexture;
+        winrt::com_ptr<ID3D11Query> Query;
+    };
+
+    winrt::com_ptr<ID3D11DeviceContext> m_d3dContext;
+    std::vector<Slot> m_slots;
+};
 
-    bool IsValid()
+using DiffReadbackRing = ReadbackRing<DiffReadbackDevice>;
+
+// Copies parts of a frame into a staging texture, leaving each part where
+// it was in the frame. Only the parts are transferred, the rest of the
+// staging texture holds whatever was there before.
+class RegionReadbackDevice
+{
+public:
+    using Result = winrt::com_ptr<ID3D11Texture2D>;
+
+    RegionReadbackDevice(
+        winrt::com_ptr<ID3D11Device> const& d3dDevice,
+        winrt::com_ptr<ID3D11DeviceContext> const& d3dContext,
+        winrt::Windows::Graphics::SizeInt32 textureSize,
+        uint32_t slotCount);
+
+    void Submit(uint32_t slot, winrt::com_ptr<ID3D11Texture2D> const& frameTexture, std::vector<DiffRect> const& regions);
+    bool TryRead(uint32_t slot, winrt::com_ptr<ID3D11Texture2D>& result);
+
+private:
+    struct Slot
     {
-        return Right >= Left && Bottom >= Top;
-    }
+        winrt::com_ptr<ID3D11Texture2D> StagingTexture;
+        winrt::com_ptr<ID3D11Query> Query;
+    };
+
+    winrt::com_ptr<ID3D11DeviceContext> m_d3dContext;
+    std::vector<Slot> m_slots;
 };
 
+using RegionReadbackRing = ReadbackRing<RegionReadbackDevice>;
+
+// Diffs each frame against the one submitted before it. Results arrive a
+// frame or two later, in order, through PollResult and WaitResult.
 class TextureDiffer
 {
 public:
@@ -31,7 +82,13 @@ public:
         winrt::com_ptr<ID3D11DeviceContext> const& d3dContext,
         winrt::Windows::Graphics::SizeInt32 textureSize);
 
-    std::optional<DiffRect> ProcessFrame(winrt::com_ptr<ID3D11Texture2D> const& frameTexture);
+    // Make room with PollResult or WaitResult first if the ring is full
+    uint64_t SubmitFrame(winrt::com_ptr<ID3D11Texture2D> const& frameTexture);
+    bool IsFull() { return m_readbacks.IsFull(); }
+    std::optional<DiffReadbackRing::Readback> PollResult() { return m_readbacks.Poll(); }
+    std::optional<DiffReadbackRing::Readback> WaitResult() { return m_readbacks.Wait(); }
+    template <typename Idle>
+    std::optional<DiffReadbackRing::Readback> WaitResult(Idle&& idle) { return m_readbacks.Wait(std::forward<Idle>(idle)); }
 
 private:
     winrt::com_ptr<ID3D11Device> m_d3dDevice;
@@ -40,9 +97,10 @@ private:
     winrt::com_ptr<ID3D11Buffer> m_diffBuffer;
     winrt::com_ptr<ID3D11UnorderedAccessView> m_diffBufferUAV;
     winrt::com_ptr<ID3D11Buffer> m_diffDefaultBuffer;
-    winrt::com_ptr<ID3D11Buffer> m_diffStagingBuffer;
+    winrt::com_ptr<ID3D11Buffer> m_fullFrameBuffer;
     winrt::com_ptr<ID3D11Texture2D> m_previousTexture;
     winrt::com_ptr<ID3D11ShaderResourceView> m_previousTextureSRV;
+    DiffReadbackRing m_readbacks;
     bool m_firstFrame = true;
     winrt::Windows::Graphics::SizeInt32 m_textureSize = {};
 };
\ No newline at end of file
@@ -2,10 +2,13 @@
 #include "WindowInfo.h"
 #include "FrameCompositor.h"
 #include "GifEncoder.h"
+#include "Benchmark.h"
+#include "CursorTracker.h"
 
 namespace winrt
 {
     using namespace Windows::Foundation;
+    using namespace Windows::Foundation::Metadata;
     using namespace Windows::Storage;
     using namespace Windows::System;
     using namespace Windows::Graphics;
@@ -20,96 +23,253 @@ namespace util
     using namespace robmikh::common::uwp;
 }
 
-winrt::IAsyncAction MainAsync(std::vector<std::wstring> const& args)
+struct CaptureTarget
 {
+    winrt::StorageFile File{ nullptr };
+    std::shared_ptr<GifEncoder> Encoder;
+    std::shared_ptr<CursorTracker> Cursor;
+    winrt::Direct3D11CaptureFramePool FramePool{ nullptr };
+    winrt::GraphicsCaptureSession Session{ nullptr };
+};
+
+// The same clock as Direct3D11CaptureFrame::SystemRelativeTime
+winrt::TimeSpan GetSystemRelativeTime()
+{
+    LARGE_INTEGER counter = {};
+    LARGE_INTEGER frequency = {};
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    // Split the conversion up so that it doesn't overflow
+    auto ticksPerSecond = winrt::TimeSpan::period::den;
+    auto seconds = counter.QuadPart / frequency.QuadPart;
+    auto remainder = counter.QuadPart % frequency.QuadPart;
+    return winrt::TimeSpan{ seconds * ticksPerSecond + (remainder * ticksPerSecond) / frequency.QuadPart };
+}
+
+// Only accepts plain numbers greater than zero
+std::optional<uint32_t> ParseCount(std::wstring const& value)
+{
+    const size_t maxDigits = 9;
+    auto isDigit = [](wchar_t character) { return character >= L'0' && character <= L'9'; };
+    if (value.empty() || value.size() > maxDigits || !std::all_of(value.begin(), value.end(), isDigit))
+    {
+        return std::nullopt;
+    }
+    auto count = static_cast<uint32_t>(std::stoul(value));
+    return count > 0 ? std::optional(count) : std::nullopt;
+}
+
+winrt::IAsyncAction MainAsync(std::vector<std::wstring> args)
+{
+    // Pull out the output format
+    auto format = OutputFormat::Gif;
+    auto formatArg = std::find(args.begin(), args.end(), L"--format");
+    if (formatArg != args.end())
+    {
+        auto formatValue = formatArg + 1 != args.end() ? *(formatArg + 1) : std::wstring();
+        if (formatValue == L"gif")
+        {
+            format = OutputFormat::Gif;
+        }
+        else if (formatValue == L"apng")
+        {
+            format = OutputFormat::Apng;
+        }
+        else
+        {
+            wprintf(L"Invalid input! Expecting 'gif' or 'apng' after --format.\n");
+            co_return;
+        }
+        args.erase(formatArg, formatArg + 2);
+    }
+
     // Arg validation
     if (args.size() <= 0)
     {
-        wprintf(L"Invalid input! Expecting a string that matches part of a window title.\n");
+        wprintf(L"Invalid input! Expecting one or more strings that match part of a window title.\n");
+        co_return;
+    }
+
+    // Run the benchmark instead of recording if asked
+    if (args[0] == L"--benchmark")
+    {
+        auto sourceCount = args.size() > 1 ? ParseCount(args[1]) : std::optional(4u);
+        auto frameCount = args.size() > 2 ? ParseCount(args[2]) : std::optional(300u);
+        if (!sourceCount.has_value() || !frameCount.has_value())
+        {
+            wprintf(L"Invalid input! Expecting positive numbers for the source and frame counts after --benchmark.\n");
+            co_return;
+        }
+        RunBenchmark(*sourceCount, *frameCount, format);
         co_return;
     }
-    auto windowQuery = args[0];
     
     // Change the console title so that we don't record ourselves
     SetConsoleTitleW(L"CaptureGifEncoder");
     co_await std::chrono::milliseconds(100);
 
-    // Find the window we want to record
-    auto matchedWindows = FindWindowsByTitle(windowQuery);
-    if (matchedWindows.size() <= 0)
+    // Find the windows we want to record, one for each query
+    std::vector<WindowInfo> windows;
+    for (auto&& windowQuery : args)
     {
-        wprintf(L"Couldn't find a window that contains '%s'!\n", windowQuery.c_str());
-        co_return;
+        auto matchedWindows = FindWindowsByTitle(windowQuery);
+        if (matchedWindows.size() <= 0)
+        {
+            wprintf(L"Couldn't find a window that contains '%s'!\n", windowQuery.c_str());
+            co_return;
+        }
+        auto window = matchedWindows[0];
+        wprintf(L"Using '%s'\n", window.Title.c_str());
+        windows.push_back(window);
     }
-    auto window = matchedWindows[0];
-    wprintf(L"Using '%s'\n", window.Title.c_str());
 
-    // Init D3D, D2D, and WIC
+    // Init D3D and WIC. All of our targets share the same device, so
+    // the immediate context needs to be protected.
     auto d3dDevice = util::CreateD3DDevice();
     winrt::com_ptr<ID3D11DeviceContext> d3dContext;
     d3dDevice->GetImmediateContext(d3dContext.put());
+    d3dContext.as<ID3D11Multithread>()->SetMultithreadProtected(true);
     auto device = CreateDirect3DDevice(d3dDevice.as<IDXGIDevice>().get());
-    auto d2dFactory = util::CreateD2DFactory();
-    auto d2dDevice = util::CreateD2DDevice(d2dFactory, d3dDevice);
     auto wicFactory = util::CreateWICFactory();
 
+    // Encoding for every target happens on one pool of threads
+    auto threadPool = std::make_shared<EncoderThreadPool>(std::thread::hardware_concurrency());
+    auto bufferPool = std::make_shared<PixelBufferPool>();
+
     // TODO: Use args to determine file name/path
     auto currentPath = std::filesystem::current_path();
     auto folder = co_await winrt::StorageFolder::GetFolderFromPathAsync(currentPath.wstring());
-    auto file = co_await folder.CreateFileAsync(L"test.gif", winrt::CreationCollisionOption::ReplaceExisting);
-    auto stream = co_await file.OpenAsync(winrt::FileAccessMode::ReadWrite);
-    
-    // Identify our capture target
-    auto item = util::CreateCaptureItemForWindow(window.WindowHandle);
-    RECT windowRect = {};
-    winrt::check_hresult(DwmGetWindowAttribute(window.WindowHandle, DWMWA_EXTENDED_FRAME_BOUNDS, reinterpret_cast<void*>(&windowRect), sizeof(windowRect)));
-    winrt::SizeInt32 captureSize = { windowRect.right - windowRect.left, windowRect.bottom - windowRect.top };
-
-    // Setup our gif encoder
-    auto encoder = std::make_shared<GifEncoder>(d3dDevice, d3dContext, d2dDevice, wicFactory, stream, captureSize);
-
-    // Setup Windows.Graphics.Capture
-    auto framePool = winrt::Direct3D11CaptureFramePool::CreateFreeThreaded(
-        device,
-        winrt::DirectXPixelFormat::B8G8R8A8UIntNormalized,
-        2,
-        captureSize);
-    auto session = framePool.CreateCaptureSession(item);
-
-    // Encode frames as they arrive. Because we created our frame pool using 
-    // Direct3D11CaptureFramePool::CreateFreeThreaded, this lambda will fire on a different thread
-    // than our current one. If you'd like the callback to fire on your thread, create the frame pool
-    // using Direct3D11CaptureFramePool::Create and make sure your thread has a DispatcherQueue and you
-    // are pumping messages.
-    framePool.FrameArrived([captureSize, d3dContext, encoder](auto& framePool, auto&)
+
+    std::vector<CaptureTarget> targets;
+    for (auto i = 0u; i < windows.size(); i++)
     {
-        auto frame = framePool.TryGetNextFrame();
-        encoder->ProcessFrame(frame);
+        auto&& window = windows[i];
+        CaptureTarget target;
+
+        auto fileName = (windows.size() == 1 ? std::wstring(L"test") : L"test" + std::to_wstring(i + 1)) + GetFileExtension(format);
+        target.File = co_await folder.CreateFileAsync(fileName, winrt::CreationCollisionOption::ReplaceExisting);
+        auto stream = co_await target.File.OpenAsync(winrt::FileAccessMode::ReadWrite);
+
+        // Identify our capture target
+        auto item = util::CreateCaptureItemForWindow(window.WindowHandle);
+        RECT windowRect = {};
+        winrt::check_hresult(DwmGetWindowAttribute(window.WindowHandle, DWMWA_EXTENDED_FRAME_BOUNDS, reinterpret_cast<void*>(&windowRect), sizeof(windowRect)));
+        winrt::SizeInt32 captureSize = { windowRect.right - windowRect.left, windowRect.bottom - windowRect.top };
+
+        // Setup our gif encoder
+        auto frameWriter = CreateFrameWriter(format, wicFactory, stream, captureSize, threadPool);
+        target.Encoder = std::make_shared<GifEncoder>(d3dDevice, d3dContext, std::move(frameWriter), captureSize, threadPool, bufferPool);
+
+        // Setup Windows.Graphics.Capture
+        target.FramePool = winrt::Direct3D11CaptureFramePool::CreateFreeThreaded(
+            device,
+            winrt::DirectXPixelFormat::B8G8R8A8UIntNormalized,
+            2,
+            captureSize);
+        target.Session = target.FramePool.CreateCaptureSession(item);
+
+        // Draw the cursor ourselves where we can, so that moving it doesn't
+        // dirty the frames we get from the capture session.
+        if (winrt::ApiInformation::IsPropertyPresent(winrt::name_of<winrt::GraphicsCaptureSession>(), L"IsCursorCaptureEnabled"))
+        {
+            target.Session.IsCursorCaptureEnabled(false);
+            target.Cursor = std::make_shared<CursorTracker>(window.WindowHandle);
+        }
+
+        // Encode frames as they arrive. Because we created our frame pool using 
+        // Direct3D11CaptureFramePool::CreateFreeThreaded, this lambda will fire on a different thread
+        // than our current one. If you'd like the callback to fire on your thread, create the frame pool
+        // using Direct3D11CaptureFramePool::Create and make sure your thread has a DispatcherQueue and you
+        // are pumping messages.
+        target.FramePool.FrameArrived([encoder = target.Encoder](auto& framePool, auto&)
+        {
+            auto frame = framePool.TryGetNextFrame();
+            encoder->ProcessFrame(frame);
+        });
+
+        targets.push_back(target);
+    }
+
+    for (auto&& target : targets)
+    {
+        target.Session.StartCapture();
+    }
+
+    // The capture session doesn't send us frames when only the cursor
+    // moves, so we keep an eye on it ourselves.
+    std::atomic<bool> recording = true;
+    std::thread cursorThread([&targets, &recording]()
+    {
+        while (recording)
+        {
+            auto timeStamp = GetSystemRelativeTime();
+            for (auto&& target : targets)
+            {
+                if (target.Cursor != nullptr)
+                {
+                    // Rendering a cursor or repeating a frame can fail, and
+                    // nothing would catch it on this thread. Skip this tick
+                    // and try again on the next one.
+                    try
+                    {
+                        target.Encoder->ProcessOverlay(target.Cursor->Update(), timeStamp);
+                    }
+                    catch (winrt::hresult_error const&)
+                    {
+                    }
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(16));
+        }
     });
 
-    session.StartCapture();
     // TODO: enable timed recording through a flag
     //co_await std::chrono::seconds(5);
     wprintf(L"Press ENTER to stop recording... ");
     // Wait for user input
     std::wstring tempString;
     std::getline(std::wcin, tempString);
+    recording = false;
+    cursorThread.join();
 
     // Stop the capture (and give it a little bit of time)
-    session.Close();
-    framePool.Close();
+    for (auto&& target : targets)
+    {
+        target.Session.Close();
+        target.FramePool.Close();
+    }
     co_await std::chrono::milliseconds(100);
 
-    // Finish our recording and display the file
-    encoder->StopEncoding();
-    co_await winrt::Launcher::LaunchFileAsync(file);
+    // Finish our recordings
+    for (auto&& target : targets)
+    {
+        target.Encoder->StopEncoding();
+        wprintf(L"%s\n", target.File.Name().c_str());
+        PrintEncoderStats(target.Encoder->Stats());
+    }
+
+    // Display the file if there's only one, otherwise list them
+    if (targets.size() == 1)
+    {
+        co_await winrt::Launcher::LaunchFileAsync(targets[0].File);
+    }
+    else
+    {
+        for (auto&& target : targets)
+        {
+            wprintf(L"Saved '%s'\n", target.File.Path().c_str());
+        }
+    }
 }
 
 int wmain(int argc, wchar_t* argv[])
 {
+    // Window bounds from DWM are always in physical pixels. Without this
+    // the cursor position we get would be scaled to whatever DPI we claim.
+    SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
     winrt::init_apartment();
     
     std::vector<std::wstring> args(argv + 1, argv + argc);
 
-    MainAsync(args).get();
+    MainAsync(std::move(args)).get();
 }
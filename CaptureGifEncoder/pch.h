@@ -26,6 +26,19 @@
 #include <chrono>
 #include <string>
 #include <iostream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <array>
+#include <limits>
+#include <optional>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 #include <wil/resource.h>
 
@@ -0,0 +1,302 @@
+#include "Deflate.h"
+#include <cstdio>
+#include <optional>
+#include <random>
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::printf("%s(%d): CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            return false; \
+        } \
+    } while (false)
+
+// Reads deflate's LSB first bit order. Reading past the end gives zeros
+// and sets Overrun, so a truncated stream fails the checks instead of
+// running off the buffer.
+class BitReader
+{
+public:
+    BitReader(std::vector<uint8_t> const& data, size_t position) : m_data(data), m_position(position) {}
+
+    uint32_t Read(uint32_t bitCount)
+    {
+        uint32_t value = 0;
+        for (auto i = 0u; i < bitCount; i++)
+        {
+            if (m_position >= m_data.size())
+            {
+                Overrun = true;
+                return 0;
+            }
+            value |= static_cast<uint32_t>((m_data[m_position] >> m_bit) & 1) << i;
+            if (++m_bit == 8)
+            {
+                m_bit = 0;
+                m_position++;
+            }
+        }
+        return value;
+    }
+
+    // Huffman codes are packed starting with their most significant bit
+    uint32_t ReadReversed(uint32_t bitCount)
+    {
+        uint32_t value = 0;
+        for (auto i = 0u; i < bitCount; i++)
+        {
+            value = (value << 1) | Read(1);
+        }
+        return value;
+    }
+
+    void AlignToByte()
+    {
+        if (m_bit > 0)
+        {
+            m_bit = 0;
+            m_position++;
+        }
+    }
+
+    size_t Position() const { return m_position; }
+
+    bool Overrun = false;
+
+private:
+    std::vector<uint8_t> const& m_data;
+    size_t m_position = 0;
+    uint32_t m_bit = 0;
+};
+
+// The fixed literal/length code from RFC 1951 3.2.6
+uint32_t ReadFixedLiteral(BitReader& reader)
+{
+    auto code = reader.ReadReversed(7);
+    if (code < 0x18)
+    {
+        return 256 + code;
+    }
+    code = (code << 1) | reader.Read(1);
+    if (code >= 0x30 && code < 0xC0)
+    {
+        return code - 0x30;
+    }
+    if (code >= 0xC0 && code < 0xC8)
+    {
+        return 280 + code - 0xC0;
+    }
+    code = (code << 1) | reader.Read(1);
+    return 144 + code - 0x190;
+}
+
+// A reference zlib decoder, written straight from RFC 1950 and 1951 rather
+// than sharing any tables with the encoder. Our encoder never emits dynamic
+// Huffman blocks, so those are treated as an error.
+std::optional<std::vector<uint8_t>> Inflate(std::vector<uint8_t> const& stream)
+{
+    const uint16_t lengthBases[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const uint16_t distanceBases[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+
+    if (stream.size() < 6 || (stream[0] & 0x0F) != 8 || ((stream[0] << 8) | stream[1]) % 31 != 0)
+    {
+        return std::nullopt;
+    }
+
+    std::vector<uint8_t> output;
+    BitReader reader(stream, 2);
+    auto final = false;
+    while (!final)
+    {
+        final = reader.Read(1) == 1;
+        auto type = reader.Read(2);
+        if (type == 0)
+        {
+            reader.AlignToByte();
+            auto length = reader.Read(16);
+            auto inverse = reader.Read(16);
+            if ((length ^ 0xFFFF) != inverse)
+            {
+                return std::nullopt;
+            }
+            for (auto i = 0u; i < length; i++)
+            {
+                output.push_back(static_cast<uint8_t>(reader.Read(8)));
+            }
+        }
+        else if (type == 1)
+        {
+            while (!reader.Overrun)
+            {
+                auto symbol = ReadFixedLiteral(reader);
+                if (symbol < 256)
+                {
+                    output.push_back(static_cast<uint8_t>(symbol));
+                    continue;
+                }
+                if (symbol == 256)
+                {
+                    break;
+                }
+
+                auto lengthIndex = symbol - 257;
+                if (lengthIndex >= 29)
+                {
+                    return std::nullopt;
+                }
+                auto lengthExtraBits = lengthIndex < 8 || lengthIndex == 28 ? 0 : (lengthIndex - 4) / 4;
+                auto length = lengthBases[lengthIndex] + reader.Read(lengthExtraBits);
+
+                auto distanceIndex = reader.ReadReversed(5);
+                if (distanceIndex >= 30)
+                {
+                    return std::nullopt;
+                }
+                auto distanceExtraBits = distanceIndex < 4 ? 0 : (distanceIndex - 2) / 2;
+                auto distance = distanceBases[distanceIndex] + reader.Read(distanceExtraBits);
+                if (distance > output.size() || distance > 32768)
+                {
+                    return std::nullopt;
+                }
+                for (auto i = 0u; i < length; i++)
+                {
+                    output.push_back(output[output.size() - distance]);
+                }
+            }
+        }
+        else
+        {
+            return std::nullopt;
+        }
+
+        if (reader.Overrun)
+        {
+            return std::nullopt;
+        }
+    }
+
+    // The checksum follows the last block, big endian
+    reader.AlignToByte();
+    auto position = reader.Position();
+    if (position + 4 != stream.size())
+    {
+        return std::nullopt;
+    }
+    auto adler = (static_cast<uint32_t>(stream[position]) << 24) | (stream[position + 1] << 16) | (stream[position + 2] << 8) | stream[position + 3];
+    if (adler != Adler32(output.data(), output.size()))
+    {
+        return std::nullopt;
+    }
+    return output;
+}
+
+// Compresses each band on its own and stitches them together the way
+// ApngFrameWriter does
+std::vector<uint8_t> CompressBands(std::vector<uint8_t> const& data, std::vector<size_t> const& bandEnds)
+{
+    auto header = ZlibHeader();
+    std::vector<uint8_t> stream(header.begin(), header.end());
+    auto adler = 1u;
+    size_t start = 0;
+    for (auto end : bandEnds)
+    {
+        auto band = DeflateBlocks(data.data() + start, end - start);
+        stream.insert(stream.end(), band.begin(), band.end());
+        adler = Adler32Combine(adler, Adler32(data.data() + start, end - start), end - start);
+        start = end;
+    }
+    auto finish = ZlibFinish(adler);
+    stream.insert(stream.end(), finish.begin(), finish.end());
+    return stream;
+}
+
+// Noise, short repeats, long runs and repeats from further back than the
+// window, so that literals and every kind of match show up
+std::vector<uint8_t> CreateTestData(size_t size, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        switch ((i / 997) % 4)
+        {
+        case 0:
+            data[i] = static_cast<uint8_t>(random());
+            break;
+        case 1:
+            data[i] = static_cast<uint8_t>(i % 7);
+            break;
+        case 2:
+            data[i] = 0xFF;
+            break;
+        default:
+            data[i] = i >= 40000 ? data[i - 40000] : static_cast<uint8_t>(i * 31);
+            break;
+        }
+    }
+    return data;
+}
+
+bool TestAdler32()
+{
+    std::vector<uint8_t> text = { 'W', 'i', 'k', 'i', 'p', 'e', 'd', 'i', 'a' };
+    CHECK(Adler32(text.data(), text.size()) == 0x11E60398);
+    CHECK(Adler32(nullptr, 0) == 1);
+
+    // Long enough that the sums have to be reduced along the way
+    auto data = CreateTestData(100000, 1);
+    auto whole = Adler32(data.data(), data.size());
+    for (auto split : { size_t(0), size_t(1), size_t(5552), size_t(65521), size_t(99999), data.size() })
+    {
+        auto first = Adler32(data.data(), split);
+        auto second = Adler32(data.data() + split, data.size() - split);
+        CHECK(Adler32(data.data() + split, data.size() - split, first) == whole);
+        CHECK(Adler32Combine(first, second, data.size() - split) == whole);
+    }
+    return true;
+}
+
+bool TestRoundTrip(std::vector<uint8_t> const& data, std::vector<size_t> const& bandEnds)
+{
+    auto stream = CompressBands(data, bandEnds);
+    auto inflated = Inflate(stream);
+    CHECK(inflated.has_value());
+    CHECK(*inflated == data);
+    return true;
+}
+
+bool TestBands()
+{
+    auto data = CreateTestData(300000, 2);
+    CHECK(TestRoundTrip(data, { data.size() }));
+    // Empty and single byte bands, and bands that start mid-match
+    CHECK(TestRoundTrip(data, { 0, 1, 70000, 70000, 150001, 299998, data.size() }));
+    // Many small bands, like a narrow frame split into rows
+    std::vector<size_t> bandEnds;
+    for (size_t end = 1000; end < data.size(); end += 1000)
+    {
+        bandEnds.push_back(end);
+    }
+    bandEnds.push_back(data.size());
+    CHECK(TestRoundTrip(data, bandEnds));
+
+    // Repetitive data should actually compress
+    std::vector<uint8_t> flat(100000, 0x42);
+    CHECK(TestRoundTrip(flat, { 50000, flat.size() }));
+    CHECK(CompressBands(flat, { flat.size() }).size() < flat.size() / 50);
+
+    std::vector<uint8_t> empty;
+    CHECK(TestRoundTrip(empty, { 0 }));
+    return true;
+}
+
+int main()
+{
+    auto passed = true;
+    passed &= TestAdler32();
+    passed &= TestBands();
+    std::printf(passed ? "passed\n" : "failed\n");
+    return passed ? 0 : 1;
+}
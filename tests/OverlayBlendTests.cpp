@@ -0,0 +1,161 @@
+#include "OverlayBlend.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::printf("%s(%d): CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            return false; \
+        } \
+    } while (false)
+
+// Source over destination for premultiplied pixels, done in floating point
+uint32_t ReferenceBlend(uint32_t destination, uint32_t source)
+{
+    auto inverseAlpha = (255 - (source >> 24)) / 255.0;
+    uint32_t result = 0;
+    for (auto shift = 0u; shift < 32; shift += 8)
+    {
+        auto channel = ((source >> shift) & 0xFF) + ((destination >> shift) & 0xFF) * inverseAlpha;
+        result |= static_cast<uint32_t>(std::min(255.0, std::floor(channel + 0.5))) << shift;
+    }
+    return result;
+}
+
+// Every alpha, every valid premultiplied color for it, and a spread of
+// destinations. A whole row goes through the SSE2 path where there is one,
+// while single pixels always take the scalar path.
+bool TestBlendMatchesReference()
+{
+    std::vector<uint32_t> sources;
+    std::vector<uint32_t> destinations;
+    for (auto alpha = 0u; alpha < 256; alpha++)
+    {
+        for (auto color = 0u; color <= alpha; color++)
+        {
+            for (auto destination = 0u; destination < 256; destination += 3)
+            {
+                sources.push_back((alpha << 24) | (color << 16) | ((alpha - color) << 8) | (color / 2));
+                destinations.push_back(0xFF000000 | (destination << 16) | ((255 - destination) << 8) | destination);
+            }
+        }
+    }
+
+    auto rowResults = destinations;
+    BlendPremultipliedRow(rowResults.data(), sources.data(), static_cast<uint32_t>(sources.size()));
+    for (auto i = 0u; i < sources.size(); i++)
+    {
+        auto expected = ReferenceBlend(destinations[i], sources[i]);
+        auto pixelResult = destinations[i];
+        BlendPremultipliedRow(&pixelResult, &sources[i], 1);
+        if (rowResults[i] != expected || pixelResult != expected)
+        {
+            std::printf("%08x over %08x: row %08x, pixel %08x, expected %08x\n", sources[i], destinations[i], rowResults[i], pixelResult, expected);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Rows whose length isn't a multiple of the vector width mix both paths
+bool TestRowTails()
+{
+    for (auto count = 0u; count < 16; count++)
+    {
+        std::vector<uint32_t> sources(count);
+        std::vector<uint32_t> destinations(count);
+        for (auto i = 0u; i < count; i++)
+        {
+            sources[i] = 0x80402010 + i * 0x00010101;
+            destinations[i] = 0xFFC0E0F0 - i * 0x00030303;
+        }
+        auto results = destinations;
+        BlendPremultipliedRow(results.data(), sources.data(), count);
+        for (auto i = 0u; i < count; i++)
+        {
+            CHECK(results[i] == ReferenceBlend(destinations[i], sources[i]));
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<PixelBuffer> CreateImage(uint32_t width, uint32_t height, uint32_t color)
+{
+    auto image = std::make_shared<PixelBuffer>();
+    image->Width = width;
+    image->Height = height;
+    image->Stride = width * 4;
+    image->Data.resize(static_cast<size_t>(image->Stride) * height);
+    std::fill_n(reinterpret_cast<uint32_t*>(image->Data.data()), static_cast<size_t>(width) * height, color);
+    return image;
+}
+
+uint32_t GetPixel(PixelBuffer const& buffer, uint32_t x, uint32_t y)
+{
+    return reinterpret_cast<uint32_t const*>(buffer.Data.data() + static_cast<size_t>(y) * buffer.Stride)[x];
+}
+
+// The overlay only lands where it overlaps both the pixels and the clip
+bool TestBlendOverlayClips()
+{
+    const uint32_t background = 0xFF000000;
+    const uint32_t opaqueRed = 0xFFFF0000;
+    OverlayPlacement overlay = { CreateImage(5, 4, opaqueRed), -2, 8 };
+
+    // The pixels cover rows 2 to 12 of the frame, the clip stops at row 11
+    auto pixels = CreateImage(10, 10, background);
+    auto pixelsRect = DiffRect{ 0, 2, 10, 12 };
+    BlendOverlay(*pixels, pixelsRect, DiffRect{ 0, 0, 100, 11 }, overlay);
+    for (auto y = 0u; y < pixels->Height; y++)
+    {
+        for (auto x = 0u; x < pixels->Width; x++)
+        {
+            auto frameY = y + pixelsRect.Top;
+            auto covered = x < 3 && frameY >= 8 && frameY < 11;
+            CHECK(GetPixel(*pixels, x, y) == (covered ? opaqueRed : background));
+        }
+    }
+
+    // Nothing overlaps
+    auto untouched = CreateImage(4, 4, background);
+    BlendOverlay(*untouched, DiffRect{ 20, 20, 24, 24 }, DiffRect{ 20, 20, 24, 24 }, overlay);
+    for (auto y = 0u; y < untouched->Height; y++)
+    {
+        for (auto x = 0u; x < untouched->Width; x++)
+        {
+            CHECK(GetPixel(*untouched, x, y) == background);
+        }
+    }
+    return true;
+}
+
+bool TestOverlayRect()
+{
+    auto image = CreateImage(5, 4, 0);
+    auto rect = GetOverlayRect(OverlayPlacement{ image, -2, 8 }, 20, 10);
+    CHECK(rect.has_value());
+    CHECK(rect->Left == 0 && rect->Top == 8 && rect->Right == 3 && rect->Bottom == 10);
+
+    CHECK(!GetOverlayRect(OverlayPlacement{ image, -5, 0 }, 20, 10).has_value());
+    CHECK(!GetOverlayRect(OverlayPlacement{ image, 20, 0 }, 20, 10).has_value());
+
+    CHECK((OverlayPlacement{ image, 1, 2 } == OverlayPlacement{ image, 1, 2 }));
+    CHECK((OverlayPlacement{ image, 1, 2 } != OverlayPlacement{ image, 1, 3 }));
+    CHECK((OverlayPlacement{ image, 1, 2 } != OverlayPlacement{ CreateImage(5, 4, 0), 1, 2 }));
+    return true;
+}
+
+int main()
+{
+    auto passed = true;
+    passed &= TestBlendMatchesReference();
+    passed &= TestRowTails();
+    passed &= TestBlendOverlayClips();
+    passed &= TestOverlayRect();
+    std::printf(passed ? "passed\n" : "failed\n");
+    return passed ? 0 : 1;
+}
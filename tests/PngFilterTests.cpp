@@ -0,0 +1,232 @@
+#include "PngFilter.h"
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <random>
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::printf("%s(%d): CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            return false; \
+        } \
+    } while (false)
+
+const uint32_t BytesPerPixel = 4;
+
+uint8_t ReferencePaeth(uint8_t a, uint8_t b, uint8_t c)
+{
+    auto p = static_cast<int32_t>(a) + b - c;
+    auto pa = std::abs(p - a);
+    auto pb = std::abs(p - b);
+    auto pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc)
+    {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+// Undoes the filters the way a PNG decoder would (PNG spec section 9),
+// one byte at a time. Returns the RGBA rows, or nothing if a filter type
+// is invalid.
+std::optional<std::vector<uint8_t>> Unfilter(std::vector<uint8_t> const& filtered, uint32_t width, uint32_t rowCount, std::array<uint32_t, 5>& filterCounts)
+{
+    auto length = static_cast<size_t>(width) * BytesPerPixel;
+    if (filtered.size() != rowCount * (length + 1))
+    {
+        return std::nullopt;
+    }
+
+    std::vector<uint8_t> rows(rowCount * length);
+    std::vector<uint8_t> zeros(length, 0);
+    for (auto y = 0u; y < rowCount; y++)
+    {
+        auto filterType = filtered[y * (length + 1)];
+        auto source = filtered.data() + y * (length + 1) + 1;
+        auto row = rows.data() + y * length;
+        auto previousRow = y > 0 ? row - length : zeros.data();
+        if (filterType >= filterCounts.size())
+        {
+            return std::nullopt;
+        }
+        filterCounts[filterType]++;
+
+        for (size_t i = 0; i < length; i++)
+        {
+            uint8_t a = i >= BytesPerPixel ? row[i - BytesPerPixel] : 0;
+            uint8_t b = previousRow[i];
+            uint8_t c = i >= BytesPerPixel ? previousRow[i - BytesPerPixel] : 0;
+            uint8_t predicted = 0;
+            switch (filterType)
+            {
+            case 1:
+                predicted = a;
+                break;
+            case 2:
+                predicted = b;
+                break;
+            case 3:
+                predicted = static_cast<uint8_t>((a + b) / 2);
+                break;
+            case 4:
+                predicted = ReferencePaeth(a, b, c);
+                break;
+            }
+            row[i] = static_cast<uint8_t>(source[i] + predicted);
+        }
+    }
+    return rows;
+}
+
+// A mix of flat areas, gradients and noise, so that every filter gets
+// picked for some rows
+PixelBuffer CreateImage(uint32_t width, uint32_t height, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    PixelBuffer image;
+    image.Width = width;
+    image.Height = height;
+    // Padded rows, like a buffer from the pool
+    image.Stride = width * 4 + 8;
+    image.Data.resize(static_cast<size_t>(image.Stride) * height);
+    for (auto y = 0u; y < height; y++)
+    {
+        auto pixels = image.Data.data() + static_cast<size_t>(y) * image.Stride;
+        for (auto x = 0u; x < width; x++)
+        {
+            uint8_t blue = 0;
+            uint8_t green = 0;
+            uint8_t red = 0;
+            switch (y % 6)
+            {
+            case 0:
+                blue = static_cast<uint8_t>(random());
+                green = static_cast<uint8_t>(random());
+                red = static_cast<uint8_t>(random());
+                break;
+            case 1:
+                blue = static_cast<uint8_t>(x * 3);
+                green = static_cast<uint8_t>(x * 5 + y);
+                red = static_cast<uint8_t>(x * 7);
+                break;
+            case 2:
+                blue = static_cast<uint8_t>(x * 3 + y * 11);
+                green = static_cast<uint8_t>(y * 13);
+                red = static_cast<uint8_t>(x + y);
+                break;
+            case 3:
+                blue = 0x20;
+                green = 0x40;
+                red = 0x60;
+                break;
+            case 4:
+                blue = static_cast<uint8_t>((x * y) ^ (random() & 3));
+                green = static_cast<uint8_t>(x * x);
+                red = static_cast<uint8_t>(y * 200 + x);
+                break;
+            default:
+            {
+                // Halfway between the pixel to the left and the one above
+                auto left = x > 0 ? pixels + (x - 1) * 4 : pixels - image.Stride;
+                auto above = pixels - image.Stride + x * 4;
+                blue = static_cast<uint8_t>((left[0] + above[0]) / 2 + random() % 2);
+                green = static_cast<uint8_t>((left[1] + above[1]) / 2 + random() % 2);
+                red = static_cast<uint8_t>((left[2] + above[2]) / 2 + random() % 2);
+                break;
+            }
+            }
+            pixels[x * 4] = blue;
+            pixels[x * 4 + 1] = green;
+            pixels[x * 4 + 2] = red;
+            // Unchanged pixels are transparent, everything else is opaque
+            pixels[x * 4 + 3] = random() % 4 == 0 ? 0 : 0xFF;
+        }
+    }
+    return image;
+}
+
+// What the PNG should hold: RGBA, with transparent pixels all zeros
+std::vector<uint8_t> ToRgba(PixelBuffer const& image)
+{
+    std::vector<uint8_t> rgba;
+    for (auto y = 0u; y < image.Height; y++)
+    {
+        auto pixels = image.Data.data() + static_cast<size_t>(y) * image.Stride;
+        for (auto x = 0u; x < image.Width; x++)
+        {
+            auto visible = pixels[x * 4 + 3] != 0;
+            rgba.push_back(visible ? pixels[x * 4 + 2] : 0);
+            rgba.push_back(visible ? pixels[x * 4 + 1] : 0);
+            rgba.push_back(visible ? pixels[x * 4] : 0);
+            rgba.push_back(pixels[x * 4 + 3]);
+        }
+    }
+    return rgba;
+}
+
+// Widths whose rows aren't a multiple of the vector width finish on the
+// scalar path, including rows too short for any vector work at all
+bool TestRoundTrip(std::array<uint32_t, 5>& filterCounts)
+{
+    for (auto width = 1u; width <= 40; width++)
+    {
+        const uint32_t height = 23;
+        auto image = CreateImage(width, height, width);
+        std::vector<uint8_t> filtered;
+        FilterPngRows(image, 0, height, filtered);
+        auto rows = Unfilter(filtered, width, height, filterCounts);
+        if (!rows.has_value() || *rows != ToRgba(image))
+        {
+            std::printf("Round trip failed for width %u\n", width);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Bands filtered on their own have to line up with the whole image
+bool TestBands()
+{
+    const uint32_t width = 37;
+    const uint32_t height = 50;
+    auto image = CreateImage(width, height, 7);
+    std::vector<uint8_t> whole;
+    FilterPngRows(image, 0, height, whole);
+
+    std::vector<uint8_t> joined;
+    uint32_t firstRow = 0;
+    for (auto rowCount : { 1u, 16u, 0u, 20u, 13u })
+    {
+        std::vector<uint8_t> band;
+        FilterPngRows(image, firstRow, rowCount, band);
+        joined.insert(joined.end(), band.begin(), band.end());
+        firstRow += rowCount;
+    }
+    CHECK(firstRow == height);
+    CHECK(joined == whole);
+    return true;
+}
+
+int main()
+{
+    std::array<uint32_t, 5> filterCounts = {};
+    auto passed = true;
+    passed &= TestRoundTrip(filterCounts);
+    passed &= TestBands();
+
+    // Otherwise the round trip didn't cover every filter
+    for (auto i = 0u; i < filterCounts.size(); i++)
+    {
+        if (filterCounts[i] == 0)
+        {
+            std::printf("Filter %u was never picked\n", i);
+            passed = false;
+        }
+    }
+    std::printf(passed ? "passed\n" : "failed\n");
+    return passed ? 0 : 1;
+}
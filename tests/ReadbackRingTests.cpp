@@ -0,0 +1,174 @@
+#include "ReadbackRing.h"
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::printf("%s(%d): CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            return false; \
+        } \
+    } while (false)
+
+// Stands in for the GPU. Each submission lands after a random number of
+// polls, and a slot's payload is cleared once it has been read, so reading
+// a slot twice or reusing one before it was read shows up as a bad value.
+struct MockReadbackDevice
+{
+    struct Result
+    {
+        int Value = -1;
+    };
+
+    MockReadbackDevice(uint32_t slotCount, uint32_t maxLatency, uint32_t seed) :
+        m_payloads(slotCount, -1), m_remainingPolls(slotCount, 0), m_maxLatency(maxLatency), m_random(seed)
+    {
+    }
+
+    void Submit(uint32_t slot, int value)
+    {
+        if (m_payloads[slot] != -1)
+        {
+            ReusedSlots++;
+        }
+        m_payloads[slot] = value;
+        m_remainingPolls[slot] = m_maxLatency > 0 ? m_random() % (m_maxLatency + 1) : 0;
+    }
+
+    bool TryRead(uint32_t slot, Result& result)
+    {
+        if (m_remainingPolls[slot] > 0)
+        {
+            m_remainingPolls[slot]--;
+            return false;
+        }
+        result.Value = m_payloads[slot];
+        m_payloads[slot] = -1;
+        return true;
+    }
+
+    uint32_t ReusedSlots = 0;
+
+private:
+    std::vector<int> m_payloads;
+    std::vector<uint32_t> m_remainingPolls;
+    uint32_t m_maxLatency = 0;
+    std::mt19937 m_random;
+};
+
+using MockReadbackRing = ReadbackRing<MockReadbackDevice>;
+
+// Drives the ring the way GifEncoder does: drain whatever has landed, wait
+// only when every slot is taken, then submit.
+bool TestInOrder(uint32_t slotCount, uint32_t maxLatency)
+{
+    MockReadbackRing ring(MockReadbackDevice(slotCount, maxLatency, slotCount * 31 + maxLatency), slotCount);
+    std::vector<int> results;
+    auto handle = [&](MockReadbackRing::Readback const& readback)
+    {
+        results.push_back(readback.Value.Value);
+        return static_cast<int>(readback.Sequence) == readback.Value.Value;
+    };
+
+    const int frameCount = 1000;
+    for (auto frame = 0; frame < frameCount; frame++)
+    {
+        while (auto readback = ring.Poll())
+        {
+            CHECK(handle(*readback));
+        }
+        if (ring.IsFull())
+        {
+            auto readback = ring.Wait();
+            CHECK(readback.has_value());
+            CHECK(handle(*readback));
+        }
+        CHECK(ring.Submit(frame) == static_cast<uint64_t>(frame));
+        CHECK(ring.InFlight() <= slotCount);
+    }
+    while (auto readback = ring.Wait())
+    {
+        CHECK(handle(*readback));
+    }
+
+    CHECK(ring.IsEmpty());
+    CHECK(!ring.Poll().has_value());
+    CHECK(ring.GetDevice().ReusedSlots == 0);
+    CHECK(results.size() == frameCount);
+    for (auto i = 0; i < frameCount; i++)
+    {
+        CHECK(results[i] == i);
+    }
+    return true;
+}
+
+// Nothing comes back before the device says so
+bool TestPollDoesNotBlock()
+{
+    MockReadbackRing ring(MockReadbackDevice(2, 0, 1), 2);
+    CHECK(!ring.Poll().has_value());
+    CHECK(!ring.Wait().has_value());
+
+    ring.Submit(7);
+    ring.Submit(8);
+    CHECK(ring.IsFull());
+    auto first = ring.Poll();
+    CHECK(first.has_value() && first->Sequence == 0 && first->Value.Value == 7);
+    CHECK(!ring.IsFull());
+    auto second = ring.Poll();
+    CHECK(second.has_value() && second->Sequence == 1 && second->Value.Value == 8);
+    CHECK(ring.IsEmpty());
+    return true;
+}
+
+// Wait hands control back between polls, and only between polls
+bool TestWaitIdles()
+{
+    MockReadbackRing ring(MockReadbackDevice(2, 5, 3), 2);
+    uint32_t idleCount = 0;
+    CHECK(!ring.Wait([&]() { idleCount++; }).has_value());
+    CHECK(idleCount == 0);
+
+    for (auto value = 0; value < 100; value++)
+    {
+        if (ring.IsFull())
+        {
+            CHECK(ring.Wait([&]() { idleCount++; }).has_value());
+        }
+        ring.Submit(value);
+    }
+    while (ring.Wait([&]() { idleCount++; }))
+    {
+    }
+    CHECK(idleCount > 0);
+
+    // Results that have already landed come back without idling
+    MockReadbackRing ready(MockReadbackDevice(2, 0, 4), 2);
+    ready.Submit(1);
+    idleCount = 0;
+    CHECK(ready.Wait([&]() { idleCount++; }).has_value());
+    CHECK(idleCount == 0);
+    return true;
+}
+
+int main()
+{
+    auto passed = TestPollDoesNotBlock();
+    passed &= TestWaitIdles();
+    for (auto slotCount : { 1u, 2u, 3u, 8u })
+    {
+        for (auto maxLatency : { 0u, 1u, 3u, 10u })
+        {
+            if (!TestInOrder(slotCount, maxLatency))
+            {
+                std::printf("TestInOrder(%u, %u) failed\n", slotCount, maxLatency);
+                passed = false;
+            }
+        }
+    }
+    std::printf(passed ? "passed\n" : "failed\n");
+    return passed ? 0 : 1;
+}